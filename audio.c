@@ -19,10 +19,12 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <SDL2/SDL.h>
 
 #include "audio.h"
+#include "mixer.h"
 
 /*
  * Native WAVE format
@@ -43,17 +45,43 @@
 /* 1 mono, 2 stereo, 4 quad, 6 (5.1) */
 #define AUDIO_CHANNELS 2
 
-/* Specifies a unit of audio data to be used at a time. Must be a power of 2 */
+/* Specifies a unit of audio data to be used at a time by default, see setAudioBufferSize(). Must be a power of 2 */
 #define AUDIO_SAMPLES 4096
 
 /* Max number of sounds that can be in the audio queue at anytime, stops too much mixing */
 #define AUDIO_MAX_SOUNDS 25
 
-/* The rate at which the volume fades when musics transition. The higher number indicates music fading faster */
-#define AUDIO_MUSIC_FADE_VALUE 2
+/* Max number of musics playing at once, e.g. one fading out while another fades in */
+#define AUDIO_MAX_MUSIC 4
+
+/* Number of voices preallocated for the mixer */
+#define AUDIO_MAX_VOICES (AUDIO_MAX_SOUNDS + AUDIO_MAX_MUSIC)
+
+/* Max number of different files playSound() and playMusic() keep loaded */
+#define AUDIO_MAX_CACHED 16
+
+/* Max number of frames mixed at a time, longer buffers are mixed in pieces */
+#define AUDIO_MIX_FRAMES 1024
+
+/* Most channels a device can have (7.1) */
+#define AUDIO_MAX_CHANNELS 8
+
+/* Size of the queue of commands from the game to the audio callback. Must be a power of 2 */
+#define AUDIO_MAX_COMMANDS 64
+
+/* Bytes of each streamed music kept in memory, a whole number of frames for up to 8 channels */
+#define AUDIO_STREAM_BUFFER (3 << 15)
+
+/* Bytes a stream reads from its file at a time, one read is done before it starts playing */
+#define AUDIO_STREAM_CHUNK (3 << 12)
+
+/* Time in milliseconds for music to fade out when another music is played with playMusic() */
+#define AUDIO_MUSIC_FADE_MS 6000
 
 /* Flags OR'd together, which specify how SDL should behave when a device cannot offer a specific feature
- * If flag is set, SDL will change the format in the actual audio file structure (as opposed to gDevice->want)
+ * If flag is set, SDL opens the device with what it actually supports (gDevice->have, as opposed to gDevice->want)
+ * rather than converting every buffer the callback fills. Sounds are converted to gDevice->have once as they load
+ * The mixer only mixes AUDIO_FORMAT, so the format itself must not change
  *
  * Note: If you're having issues with Emscripten / EMCC play around with these flags
  *
@@ -63,8 +91,7 @@
  * SDL_AUDIO_ALLOW_CHANNELS_CHANGE      Allow any number of channels (e.g. AUDIO_CHANNELS being 2, allow actual 1)
  * SDL_AUDIO_ALLOW_ANY_CHANGE           Allow all changes above
  */
-#define SDL_AUDIO_ALLOW_CHANGES 0
-// was originally SDL_AUDIO_ALLOW_ANY_CHANGE
+#define SDL_AUDIO_ALLOW_CHANGES (SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE)
 
 /*
  * Definition for the game global sound device
@@ -74,113 +101,540 @@ typedef struct privateAudioDevice
 {
     SDL_AudioDeviceID device;
     SDL_AudioSpec want;
+    SDL_AudioSpec have;
     uint8_t audioEnabled;
+    /* Opened by initAudioOffline(), there is no device and renderAudio() runs the callback */
+    uint8_t offline;
 } PrivateAudioDevice;
 
+/*
+ * Lifetime of a stream. The game thread opens a FREE stream, making it PLAYING, the callback
+ * marks it DONE once no voice is playing it, then the game thread closes it, making it FREE again
+ *
+ */
+typedef enum streamState
+{
+    STREAM_FREE,
+    STREAM_PLAYING,
+    STREAM_DONE
+} StreamState;
+
+/*
+ * A music read from its WAVE file a chunk at a time by a reader thread into a ring buffer,
+ * so only AUDIO_STREAM_BUFFER bytes of it are ever in memory
+ *
+ */
+typedef struct stream
+{
+    char * filename;
+    SDL_RWops * file;
+    uint32_t dataStart;
+    uint32_t dataLength;
+    /* Bytes in a frame of the file and of the device */
+    uint32_t sourceFrameSize;
+    uint32_t frameSize;
+    /* Only used by the reader thread, convert is NULL if the file is already in the device's format */
+    uint32_t position;
+    uint32_t writeIndex;
+    SDL_AudioStream * convert;
+    /* Only used by the callback */
+    uint32_t readIndex;
+    /* Bytes in buffer ready to be mixed */
+    SDL_atomic_t available;
+    SDL_atomic_t state;
+    /* Commands sent about this stream the callback hasn't run yet, it can't be closed until 0 */
+    SDL_atomic_t pending;
+    SDL_atomic_t stop;
+    SDL_sem * wake;
+    SDL_Thread * thread;
+    uint8_t buffer[AUDIO_STREAM_BUFFER];
+    uint8_t raw[AUDIO_STREAM_CHUNK];
+} Stream;
+
+/*
+ * One playing sound, the mixer only ever uses the preallocated gVoices
+ * It plays either a loaded sound or a stream
+ *
+ */
+typedef struct voice
+{
+    const Audio * sound;
+    Stream * stream;
+    AudioHandle handle;
+    uint32_t offset;
+    uint8_t active;
+    uint8_t loop;
+    uint8_t fade;
+    uint8_t crossfade;
+    /* Gains ramp per frame from gain to gainTarget by gainStep, see mixer.h */
+    int32_t gain;
+    int32_t gainTarget;
+    int32_t gainStep;
+} Voice;
+
+/*
+ * What a command asks the audio callback to do
+ *
+ */
+typedef enum commandType
+{
+    COMMAND_PLAY,
+    COMMAND_CROSSFADE,
+    COMMAND_STOP,
+    COMMAND_VOLUME,
+    COMMAND_FADE_OUT
+} CommandType;
+
+/*
+ * A request from the game thread to the audio callback
+ *
+ */
+typedef struct command
+{
+    CommandType type;
+    AudioHandle handle;
+    const Audio * sound;
+    Stream * stream;
+    uint8_t loop;
+    uint8_t volume;
+    int32_t gainStep;
+} Command;
+
+/*
+ * A file loaded by playSound() or playMusic(), audio is NULL if it failed to load
+ *
+ */
+typedef struct cachedAudio
+{
+    char * filename;
+    Audio * audio;
+} CachedAudio;
+
 /* File scope variables to persist data */
 static PrivateAudioDevice * gDevice;
-static uint32_t gSoundCount;
+static Voice gVoices[AUDIO_MAX_VOICES];
+static int32_t gMix[AUDIO_MIX_FRAMES * AUDIO_MAX_CHANNELS];
+static CachedAudio gCache[AUDIO_MAX_CACHED];
+static Stream gStreams[AUDIO_MAX_MUSIC];
+
+/* Single producer (game thread), single consumer (audio callback) ring of commands.
+ * Only the game thread writes gCommandTail and only the callback writes gCommandHead */
+static Command gCommands[AUDIO_MAX_COMMANDS];
+static SDL_atomic_t gCommandHead;
+static SDL_atomic_t gCommandTail;
+
+/* Handle given to the next sound played, only used by the game thread */
+static AudioHandle gNextHandle = 1;
+
+/* Frames per buffer asked for by setAudioBufferSize() */
+static uint16_t gSamples = AUDIO_SAMPLES;
+
+/* Callback timing, only written by the callback and read with getAudioStats() */
+static SDL_atomic_t gCallbacks;
+static SDL_atomic_t gOverruns;
+static SDL_atomic_t gWorstUs;
+static SDL_atomic_t gAverageUs;
+static uint64_t gTotalCallbackTime;
+static SDL_atomic_t gUnderruns;
 
 /*
- * Add a music to the queue, addAudio wrapper for music due to fade
+ * Find a file loaded by playSound() or playMusic(), loading it the first time
  *
- * @param newAudio       New Audio to add
+ * @param filename      Filename of the WAVE file
+ * @param loop          See createAudio
+ *
+ * @return returns the loaded Audio or NULL on failure
  *
  */
-static void addMusic(Audio * root, Audio * newAudio);
+static Audio * getCachedAudio(const char * filename, uint8_t loop);
 
 /*
- * Wrapper function for playMusic, playSound, playMusicFromMemory, playSoundFromMemory
+ * Gain change per frame so a full volume fade takes fadeMs
  *
- * @param filename      Provide a filename to load WAV from, or NULL if using FromMemory
- * @param audio         Provide an Audio object if copying from memory, or NULL if using a filename
- * @param sound         1 if looping (music), 0 otherwise (sound)
+ * @param fadeMs        Length of the fade in milliseconds
+ *
+ */
+static int32_t gainStepFor(uint32_t fadeMs);
+
+/*
+ * Queue a command for the audio callback, never blocks
+ *
+ * @param command       Command to send, its handle is filled in if 0
+ *
+ * @return returns the command's handle or 0 if the queue is full
+ *
+ */
+static AudioHandle sendCommand(Command * command);
+
+/*
+ * Carry out every command queued since the last callback, only called from the callback
+ *
+ */
+static void runCommands(void);
+
+/*
+ * Fade out every music currently playing, only called from the callback
+ *
+ * @param step          Gain change per frame, 0 to fade over AUDIO_MUSIC_FADE_MS
+ *
+ */
+static void fadeOutMusic(int32_t step);
+
+/*
+ * Find a free voice, only called from the callback
+ *
+ * @param loop          1 for a music voice, 0 for a sound
+ *
+ * @return returns a free voice or NULL if there are already too many playing
+ *
+ */
+static Voice * findFreeVoice(uint8_t loop);
+
+/*
+ * Find the voice playing a handle, only called from the callback
+ *
+ * @param handle        Handle of the sound
+ *
+ * @return returns the voice or NULL if it has finished
+ *
+ */
+static Voice * findVoice(AudioHandle handle);
+
+/*
+ * Mix a voice into the accumulator, advancing it, only called from the callback
+ *
+ * @param voice         Voice to mix
+ * @param acc           Accumulator to add the voice's samples to
+ * @param frames        Number of frames to mix
+ * @param channels      Number of channels in each frame
+ *
+ */
+static void mixVoice(Voice * voice, int32_t * acc, uint32_t frames, uint32_t channels);
+
+/*
+ * Initialize audio, opening the device or mixing offline
+ *
+ * @param offline       1 to open no device and mix with renderAudio() instead
+ *
+ */
+static void startAudio(uint8_t offline);
+
+/*
+ * Stop a voice, only called from the callback
+ *
+ * @param voice         Voice to stop
+ *
+ */
+static void stopVoice(Voice * voice);
+
+/*
+ * Check a sound is in the format of the audio device, so can be mixed
+ *
+ * @param audio         Sound to check
+ *
+ * @return returns 1 if it matches, 0 (with a warning) if it was loaded before the device was opened
+ *
+ */
+static int matchesDevice(const Audio * audio);
+
+/*
+ * Convert a loaded sound to the format of the audio device, only once the device is open
+ *
+ * @param audio         Sound to convert
+ *
+ * @return returns 1 on success or if it didn't need converting, 0 on failure
+ *
+ */
+static int convertAudio(Audio * audio);
+
+/*
+ * Read the header of a WAVE file, leaving the file at the start of its samples
+ *
+ * @param file          File to read
+ * @param spec          Filled in with the format of the samples
+ * @param dataLength    Filled in with the length of the samples in bytes
+ *
+ * @return returns 1 if it is a 16 bit PCM WAVE file, 0 otherwise
+ *
+ */
+static int readWaveHeader(SDL_RWops * file, SDL_AudioSpec * spec, uint32_t * dataLength);
+
+/*
+ * Open a WAVE file to stream, reading the first chunk and starting its reader thread
+ *
+ * @param filename      Filename of the WAVE file
+ *
+ * @return returns a PLAYING stream or NULL on failure
+ *
+ */
+static Stream * openStream(const char * filename);
+
+/*
+ * Read whole frames from a stream's file, from the start again once the end of the file is reached
+ *
+ * @param stream        Stream to read
+ * @param buffer        Buffer to read into
+ * @param length        Most bytes to read
+ *
+ * @return returns the number of bytes read
+ *
+ */
+static uint32_t readStream(Stream * stream, uint8_t * buffer, uint32_t length);
+
+/*
+ * Read up to AUDIO_STREAM_CHUNK bytes into a stream, converting them to the device's format
+ *
+ * @param stream        Stream to fill
+ *
+ * @return returns the number of bytes read or converted, 0 if the buffer is full or the file can't be read
+ *
+ */
+static uint32_t fillStream(Stream * stream);
+
+/*
+ * Reader thread keeping a stream's buffer full
+ *
+ * @param data          Stream to fill
+ *
+ */
+static int streamReader(void * data);
+
+/*
+ * Close streams the callback has finished with, only called from the game thread
+ *
+ * @param all           1 to close every stream, only once the audio device is closed
+ *
+ */
+static void closeStreams(uint8_t all);
+
+/*
+ * Queue a command to play a streamed music
+ *
+ * @param filename      Filename of the WAVE file
  * @param volume        See playSound for explanation
+ * @param type          COMMAND_PLAY or COMMAND_CROSSFADE
+ * @param gainStep      See Voice
+ *
+ * @return returns the handle of the music or 0 on failure
  *
  */
-static inline void playAudio(const char * filename, Audio * audio, uint8_t loop, int volume);
+static AudioHandle playStream(const char * filename, int volume, CommandType type, int32_t gainStep);
 
 /*
- * Add a sound to the end of the queue
+ * Wrapper function for playMusic, playSound, playMusicFromMemory, playSoundFromMemory
+ *
+ * @param filename      Provide a filename to load WAV from, or NULL if using FromMemory
+ * @param audio         Provide an Audio object if copying from memory, or NULL if using a filename
+ * @param sound         1 if looping (music), 0 otherwise (sound)
+ * @param volume        See playSound for explanation
  *
- * @param root           Root of queue
- * @param newAudio       New Audio to add
+ * @return returns the handle of the new sound or 0 on failure
  *
  */
-static void addAudio(Audio * root, Audio * newAudio);
+static inline AudioHandle playAudio(const char * filename, Audio * audio, uint8_t loop, int volume);
 
 /*
  * Audio callback function for OpenAudioDevice
  *
- * @param userdata      Points to linked list of sounds to play, first being a placeholder
+ * @param userdata      Unused, the voices are in gVoices
  * @param stream        Stream to mix sound into
  * @param len           Length of sound to play
  *
  */
 static inline void audioCallback(void * userdata, uint8_t * stream, int len);
 
-void playSound(const char * filename, int volume)
+AudioHandle playSound(const char * filename, int volume)
+{
+    return playAudio(filename, NULL, 0, volume);
+}
+
+AudioHandle playMusic(const char * filename, int volume)
+{
+    return playStream(filename, volume, COMMAND_PLAY, 0);
+}
+
+AudioHandle playSoundFromMemory(Audio * audio, int volume)
+{
+    return playAudio(NULL, audio, 0, volume);
+}
+
+AudioHandle playMusicFromMemory(Audio * audio, int volume)
+{
+    return playAudio(NULL, audio, 1, volume);
+}
+
+AudioHandle crossfadeMusicFromMemory(Audio * audio, int volume, uint32_t fadeMs)
+{
+    Command command;
+    AudioHandle handle;
+
+    if(gDevice == NULL || !gDevice->audioEnabled || (audio != NULL && !matchesDevice(audio)))
+    {
+        return 0;
+    }
+
+    command.type = COMMAND_CROSSFADE;
+    command.handle = 0;
+    command.sound = audio;
+    command.stream = NULL;
+    command.loop = 1;
+    command.volume = volume < 0 ? 0 : volume > SDL_MIX_MAXVOLUME ? SDL_MIX_MAXVOLUME : volume;
+    command.gainStep = gainStepFor(fadeMs);
+
+    handle = sendCommand(&command);
+
+    return audio == NULL ? 0 : handle;
+}
+
+AudioHandle crossfadeMusicStream(const char * filename, int volume, uint32_t fadeMs)
 {
-    playAudio(filename, NULL, 0, volume);
+    if(gDevice == NULL || !gDevice->audioEnabled)
+    {
+        return 0;
+    }
+
+    return playStream(filename, volume, COMMAND_CROSSFADE, gainStepFor(fadeMs));
 }
 
-void playMusic(const char * filename, int volume)
+void stopAudio(AudioHandle handle)
 {
-    playAudio(filename, NULL, 1, volume);
+    Command command;
+
+    if(gDevice == NULL || !gDevice->audioEnabled || handle == 0)
+    {
+        return;
+    }
+
+    command.type = COMMAND_STOP;
+    command.handle = handle;
+    command.sound = NULL;
+    command.stream = NULL;
+    command.loop = 0;
+    command.volume = 0;
+    command.gainStep = 0;
+
+    sendCommand(&command);
 }
 
-void playSoundFromMemory(Audio * audio, int volume)
+void setAudioVolume(AudioHandle handle, int volume, uint32_t fadeMs)
 {
-    playAudio(NULL, audio, 0, volume);
+    Command command;
+
+    if(gDevice == NULL || !gDevice->audioEnabled || handle == 0)
+    {
+        return;
+    }
+
+    command.type = COMMAND_VOLUME;
+    command.handle = handle;
+    command.sound = NULL;
+    command.stream = NULL;
+    command.loop = 0;
+    command.volume = volume < 0 ? 0 : volume > SDL_MIX_MAXVOLUME ? SDL_MIX_MAXVOLUME : volume;
+    command.gainStep = fadeMs == 0 ? 0 : gainStepFor(fadeMs);
+
+    sendCommand(&command);
 }
 
-void playMusicFromMemory(Audio * audio, int volume)
+void fadeOutAudio(AudioHandle handle, uint32_t fadeMs)
 {
-    playAudio(NULL, audio, 1, volume);
+    Command command;
+
+    if(gDevice == NULL || !gDevice->audioEnabled || handle == 0)
+    {
+        return;
+    }
+
+    command.type = COMMAND_FADE_OUT;
+    command.handle = handle;
+    command.sound = NULL;
+    command.stream = NULL;
+    command.loop = 0;
+    command.volume = 0;
+    command.gainStep = gainStepFor(fadeMs);
+
+    sendCommand(&command);
 }
 
 void initAudio(void)
 {
-    Audio * global;
-    gDevice = (PrivateAudioDevice *) calloc(1, sizeof(PrivateAudioDevice));
-    gSoundCount = 0;
+    startAudio(0);
+}
 
-    if(gDevice == NULL)
+void initAudioOffline(void)
+{
+    startAudio(1);
+}
+
+void renderAudio(uint8_t * buffer, int length)
+{
+    int i;
+
+    if(gDevice == NULL || !gDevice->offline)
     {
-        fprintf(stderr, "[%s: %d]Fatal Error: Memory c-allocation error\n", __FILE__, __LINE__);
         return;
     }
 
-    gDevice->audioEnabled = 0;
+    /* There are no reader threads, so read everything the callback could need first */
+    for(i = 0; i < AUDIO_MAX_MUSIC; i++)
+    {
+        if(SDL_AtomicGet(&gStreams[i].state) == STREAM_PLAYING)
+        {
+            while(fillStream(&gStreams[i]) != 0)
+            {
+            }
+        }
+    }
 
-    if(!(SDL_WasInit(SDL_INIT_AUDIO) & SDL_INIT_AUDIO))
+    audioCallback(NULL, buffer, length);
+}
+
+static void startAudio(uint8_t offline)
+{
+    gDevice = (PrivateAudioDevice *) calloc(1, sizeof(PrivateAudioDevice));
+    SDL_memset(gVoices, 0, sizeof(gVoices));
+    SDL_AtomicSet(&gCommandHead, 0);
+    SDL_AtomicSet(&gCommandTail, 0);
+    SDL_AtomicSet(&gCallbacks, 0);
+    SDL_AtomicSet(&gOverruns, 0);
+    SDL_AtomicSet(&gWorstUs, 0);
+    SDL_AtomicSet(&gAverageUs, 0);
+    SDL_AtomicSet(&gUnderruns, 0);
+    gTotalCallbackTime = 0;
+
+    if(gDevice == NULL)
     {
-        fprintf(stderr, "[%s: %d]Error: SDL_INIT_AUDIO not initialized\n", __FILE__, __LINE__);
+        fprintf(stderr, "[%s: %d]Fatal Error: Memory c-allocation error\n", __FILE__, __LINE__);
         return;
     }
 
+    gDevice->audioEnabled = 0;
+    gDevice->offline = offline;
+
     SDL_memset(&(gDevice->want), 0, sizeof(gDevice->want));
 
     (gDevice->want).freq = AUDIO_FREQUENCY;
     (gDevice->want).format = AUDIO_FORMAT;
     (gDevice->want).channels = AUDIO_CHANNELS;
-    (gDevice->want).samples = AUDIO_SAMPLES;
+    (gDevice->want).samples = gSamples;
     (gDevice->want).callback = audioCallback;
-    (gDevice->want).userdata = calloc(1, sizeof(Audio));
+    (gDevice->want).userdata = NULL;
 
-    global = (Audio *) (gDevice->want).userdata;
-
-    if(global == NULL)
+    if(offline)
     {
-        fprintf(stderr, "[%s: %d]Error: Memory allocation error\n", __FILE__, __LINE__);
+        /* Mix exactly what was asked for, nothing else needs SDL's audio */
+        gDevice->have = gDevice->want;
+        gDevice->audioEnabled = 1;
         return;
     }
 
-    global->buffer = NULL;
-    global->next = NULL;
+    if(!(SDL_WasInit(SDL_INIT_AUDIO) & SDL_INIT_AUDIO))
+    {
+        fprintf(stderr, "[%s: %d]Error: SDL_INIT_AUDIO not initialized\n", __FILE__, __LINE__);
+        return;
+    }
 
-    /* want.userdata = newAudio; */
-    if((gDevice->device = SDL_OpenAudioDevice(NULL, 0, &(gDevice->want), NULL, SDL_AUDIO_ALLOW_CHANGES)) == 0)
+    if((gDevice->device = SDL_OpenAudioDevice(NULL, 0, &(gDevice->want), &(gDevice->have), SDL_AUDIO_ALLOW_CHANGES)) == 0)
     {
         fprintf(stderr, "[%s: %d]Warning: failed to open audio device: %s\n", __FILE__, __LINE__, SDL_GetError());
     }
@@ -196,22 +650,61 @@ void initAudio(void)
 
 void endAudio(void)
 {
-    if(gDevice->audioEnabled)
+    int i;
+
+    if(gDevice->audioEnabled && !gDevice->offline)
     {
         pauseAudio();
 
-        freeAudio((Audio *) (gDevice->want).userdata);
-
         /* Close down audio */
         SDL_CloseAudioDevice(gDevice->device);
     }
 
+    closeStreams(1);
+
+    SDL_memset(gVoices, 0, sizeof(gVoices));
+
+    /* Nothing can be playing the cached files now */
+    for(i = 0; i < AUDIO_MAX_CACHED; i++)
+    {
+        free(gCache[i].filename);
+        freeAudio(gCache[i].audio);
+        gCache[i].filename = NULL;
+        gCache[i].audio = NULL;
+    }
+
     free(gDevice);
+    gDevice = NULL;
+}
+
+void setAudioBufferSize(uint16_t samples)
+{
+    gSamples = samples;
+}
+
+void getAudioStats(AudioStats * stats)
+{
+    SDL_memset(stats, 0, sizeof(*stats));
+
+    if(gDevice == NULL)
+    {
+        return;
+    }
+
+    stats->frequency = (gDevice->have).freq;
+    stats->channels = (gDevice->have).channels;
+    stats->samples = (gDevice->have).samples;
+    stats->deadlineUs = (uint64_t) (gDevice->have).samples * 1000000 / (gDevice->have).freq;
+    stats->callbacks = SDL_AtomicGet(&gCallbacks);
+    stats->overruns = SDL_AtomicGet(&gOverruns);
+    stats->worstUs = SDL_AtomicGet(&gWorstUs);
+    stats->averageUs = SDL_AtomicGet(&gAverageUs);
+    stats->underruns = SDL_AtomicGet(&gUnderruns);
 }
 
 void pauseAudio(void)
 {
-    if(gDevice->audioEnabled)
+    if(gDevice->audioEnabled && !gDevice->offline)
     {
         SDL_PauseAudioDevice(gDevice->device, 1);
     }
@@ -219,7 +712,7 @@ void pauseAudio(void)
 
 void unpauseAudio(void)
 {
-    if(gDevice->audioEnabled)
+    if(gDevice->audioEnabled && !gDevice->offline)
     {
         SDL_PauseAudioDevice(gDevice->device, 0);
     }
@@ -227,245 +720,944 @@ void unpauseAudio(void)
 
 void freeAudio(Audio * audio)
 {
-    Audio * temp;
-
-    while(audio != NULL)
+    if(audio != NULL)
     {
-        if(audio->free == 1)
-        {
-            SDL_FreeWAV(audio->bufferTrue);
-        }
-
-        temp = audio;
-        audio = audio->next;
-
-        free(temp);
+        SDL_FreeWAV(audio->buffer);
+        free(audio);
     }
 }
 
 Audio * createAudio(const char * filename, uint8_t loop, int volume)
 {
-    Audio * newAudio = (Audio *) calloc(1, sizeof(Audio));
+    Audio * newAudio;
 
-    if(newAudio == NULL)
+    if(filename == NULL)
     {
-        fprintf(stderr, "[%s: %d]Error: Memory allocation error\n", __FILE__, __LINE__);
+        fprintf(stderr, "[%s: %d]Warning: filename: NULL\n", __FILE__, __LINE__);
         return NULL;
     }
 
-    if(filename == NULL)
+    newAudio = (Audio *) calloc(1, sizeof(Audio));
+
+    if(newAudio == NULL)
     {
-        fprintf(stderr, "[%s: %d]Warning: filename: NULL\n", __FILE__, __LINE__);
+        fprintf(stderr, "[%s: %d]Error: Memory allocation error\n", __FILE__, __LINE__);
         return NULL;
     }
 
-    newAudio->next = NULL;
     newAudio->loop = loop;
-    newAudio->fade = 0;
-    newAudio->free = 1;
     newAudio->volume = volume;
 
-    if(SDL_LoadWAV(filename, &(newAudio->audio), &(newAudio->bufferTrue), &(newAudio->lengthTrue)) == NULL)
+    if(SDL_LoadWAV(filename, &(newAudio->audio), &(newAudio->buffer), &(newAudio->length)) == NULL)
     {
         fprintf(stderr, "[%s: %d]Warning: failed to open wave file: %s error: %s\n", __FILE__, __LINE__, filename, SDL_GetError());
         free(newAudio);
         return NULL;
     }
 
-    newAudio->buffer = newAudio->bufferTrue;
-    newAudio->length = newAudio->lengthTrue;
     (newAudio->audio).callback = NULL;
     (newAudio->audio).userdata = NULL;
 
-    return newAudio;
-}
+    if(!convertAudio(newAudio))
+    {
+        freeAudio(newAudio);
+        return NULL;
+    }
+
+    return newAudio;
+}
 
-static inline void playAudio(const char * filename, Audio * audio, uint8_t loop, int volume)
+static int matchesDevice(const Audio * audio)
 {
-    Audio * newAudio;
+    if((audio->audio).format != (gDevice->have).format || (audio->audio).freq != (gDevice->have).freq || (audio->audio).channels != (gDevice->have).channels)
+    {
+        fprintf(stderr, "[%s: %d]Warning: sound doesn't match the device's format, load it after initAudio()\n", __FILE__, __LINE__);
+        return 0;
+    }
 
-    /* Check if audio is enabled */
-    if(!gDevice->audioEnabled)
+    return 1;
+}
+
+static int convertAudio(Audio * audio)
+{
+    SDL_AudioSpec * have;
+    SDL_AudioStream * convert;
+    uint8_t * buffer;
+    int length;
+
+    /* Nothing to convert to until the device is open, the mixer won't play it */
+    if(gDevice == NULL || !gDevice->audioEnabled)
     {
-        return;
+        return 1;
     }
 
-    /* If sound, check if under max number of sounds allowed, else don't play */
-    if(loop == 0)
+    have = &(gDevice->have);
+
+    if((audio->audio).format == have->format && (audio->audio).freq == have->freq && (audio->audio).channels == have->channels)
     {
-        if(gSoundCount >= AUDIO_MAX_SOUNDS)
+        return 1;
+    }
+
+    convert = SDL_NewAudioStream((audio->audio).format, (audio->audio).channels, (audio->audio).freq, have->format, have->channels, have->freq);
+
+    if(convert == NULL || SDL_AudioStreamPut(convert, audio->buffer, audio->length) != 0 || SDL_AudioStreamFlush(convert) != 0)
+    {
+        fprintf(stderr, "[%s: %d]Warning: failed to convert sound to the device's format: %s\n", __FILE__, __LINE__, SDL_GetError());
+        SDL_FreeAudioStream(convert);
+        return 0;
+    }
+
+    length = SDL_AudioStreamAvailable(convert);
+
+    /* Allocated the way SDL_LoadWAV allocates, so freeAudio can free either */
+    if((buffer = (uint8_t *) SDL_malloc(length)) == NULL || SDL_AudioStreamGet(convert, buffer, length) != length)
+    {
+        fprintf(stderr, "[%s: %d]Error: Memory allocation error\n", __FILE__, __LINE__);
+        SDL_free(buffer);
+        SDL_FreeAudioStream(convert);
+        return 0;
+    }
+
+    SDL_FreeAudioStream(convert);
+    SDL_FreeWAV(audio->buffer);
+
+    audio->buffer = buffer;
+    audio->length = length;
+    (audio->audio).format = have->format;
+    (audio->audio).freq = have->freq;
+    (audio->audio).channels = have->channels;
+
+    return 1;
+}
+
+static Audio * getCachedAudio(const char * filename, uint8_t loop)
+{
+    int i;
+
+    for(i = 0; i < AUDIO_MAX_CACHED && gCache[i].filename != NULL; i++)
+    {
+        if(strcmp(gCache[i].filename, filename) == 0)
         {
-            return;
+            return gCache[i].audio;
+        }
+    }
+
+    if(i == AUDIO_MAX_CACHED)
+    {
+        fprintf(stderr, "[%s: %d]Warning: too many sound files to cache: %s\n", __FILE__, __LINE__, filename);
+        return NULL;
+    }
+
+    gCache[i].filename = SDL_strdup(filename);
+
+    if(gCache[i].filename == NULL)
+    {
+        fprintf(stderr, "[%s: %d]Error: Memory allocation error\n", __FILE__, __LINE__);
+        return NULL;
+    }
+
+    /* Remember failures too, so a missing file isn't looked for every time */
+    gCache[i].audio = createAudio(filename, loop, SDL_MIX_MAXVOLUME);
+
+    return gCache[i].audio;
+}
+
+static int readWaveHeader(SDL_RWops * file, SDL_AudioSpec * spec, uint32_t * dataLength)
+{
+    char id[4];
+    uint32_t size;
+    uint16_t format;
+    uint16_t bits;
+
+    SDL_memset(spec, 0, sizeof(*spec));
+
+    if(SDL_RWread(file, id, 1, 4) != 4 || memcmp(id, "RIFF", 4) != 0)
+    {
+        return 0;
+    }
+
+    SDL_ReadLE32(file);
+
+    if(SDL_RWread(file, id, 1, 4) != 4 || memcmp(id, "WAVE", 4) != 0)
+    {
+        return 0;
+    }
+
+    while(SDL_RWread(file, id, 1, 4) == 4)
+    {
+        size = SDL_ReadLE32(file);
+
+        if(memcmp(id, "fmt ", 4) == 0 && size >= 16)
+        {
+            format = SDL_ReadLE16(file);
+            spec->channels = SDL_ReadLE16(file);
+            spec->freq = SDL_ReadLE32(file);
+            SDL_ReadLE32(file);
+            SDL_ReadLE16(file);
+            bits = SDL_ReadLE16(file);
+
+            /* Only plain 16 bit PCM is streamed */
+            if(format != 1 || bits != 16)
+            {
+                return 0;
+            }
+
+            spec->format = AUDIO_S16LSB;
+            SDL_RWseek(file, size - 16 + (size & 1), RW_SEEK_CUR);
+        }
+        else if(memcmp(id, "data", 4) == 0)
+        {
+            *dataLength = size;
+
+            return spec->channels != 0;
         }
         else
         {
-            gSoundCount++;
+            SDL_RWseek(file, size + (size & 1), RW_SEEK_CUR);
         }
     }
 
-    /* Load from filename or from Memory */
-    if(filename != NULL)
+    return 0;
+}
+
+static Stream * openStream(const char * filename)
+{
+    Stream * stream = NULL;
+    SDL_AudioSpec spec;
+    int i;
+
+    for(i = 0; i < AUDIO_MAX_MUSIC && stream == NULL; i++)
+    {
+        if(SDL_AtomicGet(&gStreams[i].state) == STREAM_FREE)
+        {
+            stream = &gStreams[i];
+        }
+    }
+
+    if(stream == NULL)
+    {
+        fprintf(stderr, "[%s: %d]Warning: too many musics streaming: %s\n", __FILE__, __LINE__, filename);
+        return NULL;
+    }
+
+    if((stream->file = SDL_RWFromFile(filename, "rb")) == NULL)
+    {
+        fprintf(stderr, "[%s: %d]Warning: failed to open wave file: %s error: %s\n", __FILE__, __LINE__, filename, SDL_GetError());
+        return NULL;
+    }
+
+    if(!readWaveHeader(stream->file, &spec, &(stream->dataLength)))
     {
-        /* Create new music sound with loop */
-        newAudio = createAudio(filename, loop, volume);
+        fprintf(stderr, "[%s: %d]Warning: can't stream wave file, it must be 16 bit PCM: %s\n", __FILE__, __LINE__, filename);
+        SDL_RWclose(stream->file);
+        return NULL;
     }
-    else if(audio != NULL)
+
+    stream->convert = NULL;
+
+    if(spec.freq != (gDevice->have).freq || spec.channels != (gDevice->have).channels)
     {
-        newAudio = (Audio *) malloc(sizeof(Audio));
+        stream->convert = SDL_NewAudioStream(spec.format, spec.channels, spec.freq, (gDevice->have).format, (gDevice->have).channels, (gDevice->have).freq);
 
-        if(newAudio == NULL)
+        if(stream->convert == NULL)
         {
-            fprintf(stderr, "[%s: %d]Fatal Error: Memory allocation error\n", __FILE__, __LINE__);
-            return;
+            fprintf(stderr, "[%s: %d]Warning: can't convert wave file to the device's format: %s error: %s\n", __FILE__, __LINE__, filename, SDL_GetError());
+            SDL_RWclose(stream->file);
+            return NULL;
         }
+    }
+
+    stream->sourceFrameSize = spec.channels * sizeof(int16_t);
+    stream->frameSize = (gDevice->have).channels * sizeof(int16_t);
+    stream->dataStart = SDL_RWtell(stream->file);
+    stream->dataLength -= stream->dataLength % stream->sourceFrameSize;
+    stream->position = 0;
+    stream->writeIndex = 0;
+    stream->readIndex = 0;
+    SDL_AtomicSet(&(stream->available), 0);
+    SDL_AtomicSet(&(stream->pending), 0);
+    SDL_AtomicSet(&(stream->stop), 0);
+
+    /* Have something to play straight away, the rest is read while playing */
+    fillStream(stream);
+
+    stream->filename = SDL_strdup(filename);
+    stream->wake = SDL_CreateSemaphore(0);
+    stream->thread = (stream->filename != NULL && stream->wake != NULL && !gDevice->offline) ? SDL_CreateThread(streamReader, "music", stream) : NULL;
+
+    /* Offline, renderAudio() reads the stream instead */
+    if(stream->filename == NULL || stream->wake == NULL || (stream->thread == NULL && !gDevice->offline))
+    {
+        fprintf(stderr, "[%s: %d]Error: failed to start reading %s: %s\n", __FILE__, __LINE__, filename, SDL_GetError());
+        free(stream->filename);
 
-        memcpy(newAudio, audio, sizeof(Audio));
+        if(stream->wake != NULL)
+        {
+            SDL_DestroySemaphore(stream->wake);
+        }
 
-        newAudio->volume = volume;
-        newAudio->loop = loop;
-        newAudio->free = 0;
+        SDL_FreeAudioStream(stream->convert);
+        SDL_RWclose(stream->file);
+        return NULL;
+    }
+
+    SDL_AtomicSet(&(stream->state), STREAM_PLAYING);
+
+    return stream;
+}
+
+static uint32_t readStream(Stream * stream, uint8_t * buffer, uint32_t length)
+{
+    uint32_t got;
+
+    length = length > stream->dataLength - stream->position ? stream->dataLength - stream->position : length;
+    length -= length % stream->sourceFrameSize;
+
+    if(length == 0)
+    {
+        return 0;
+    }
+
+    got = SDL_RWread(stream->file, buffer, 1, length);
+    got -= got % stream->sourceFrameSize;
+    stream->position += got;
+
+    /* Loop seamlessly, a short read means the file is shorter than its header says */
+    if(stream->position >= stream->dataLength || got < length)
+    {
+        SDL_RWseek(stream->file, stream->dataStart, RW_SEEK_SET);
+        stream->position = 0;
+    }
+
+    return got;
+}
+
+static uint32_t fillStream(Stream * stream)
+{
+    uint32_t length = AUDIO_STREAM_BUFFER - SDL_AtomicGet(&(stream->available));
+    uint32_t read = 0;
+    int got;
+
+    length = length > AUDIO_STREAM_CHUNK ? AUDIO_STREAM_CHUNK : length;
+    length = length > AUDIO_STREAM_BUFFER - stream->writeIndex ? AUDIO_STREAM_BUFFER - stream->writeIndex : length;
+    length -= length % stream->frameSize;
+
+    if(length == 0)
+    {
+        return 0;
+    }
+
+    if(stream->convert == NULL)
+    {
+        got = readStream(stream, stream->buffer + stream->writeIndex, length);
     }
     else
+    {
+        /* The converter carries on across the loop, so it stays seamless */
+        if((uint32_t) SDL_AudioStreamAvailable(stream->convert) < length)
+        {
+            read = readStream(stream, stream->raw, AUDIO_STREAM_CHUNK);
+            SDL_AudioStreamPut(stream->convert, stream->raw, read);
+        }
+
+        got = SDL_AudioStreamGet(stream->convert, stream->buffer + stream->writeIndex, length);
+        got = got < 0 ? 0 : got;
+    }
+
+    stream->writeIndex = (stream->writeIndex + got) % AUDIO_STREAM_BUFFER;
+
+    /* Publish the samples only once they are written */
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicAdd(&(stream->available), got);
+
+    return got + read;
+}
+
+static int streamReader(void * data)
+{
+    Stream * stream = (Stream *) data;
+
+    while(!SDL_AtomicGet(&(stream->stop)))
+    {
+        if(fillStream(stream) == 0)
+        {
+            /* Buffer full, wait for the callback to use some */
+            SDL_SemWaitTimeout(stream->wake, 100);
+        }
+    }
+
+    return 0;
+}
+
+static void closeStreams(uint8_t all)
+{
+    Stream * stream;
+    int i;
+
+    for(i = 0; i < AUDIO_MAX_MUSIC; i++)
+    {
+        stream = &gStreams[i];
+
+        /* Check pending first, the callback only lowers it after it has finished changing the state */
+        if(SDL_AtomicGet(&(stream->state)) == STREAM_FREE || (!all && (SDL_AtomicGet(&(stream->pending)) != 0 || SDL_AtomicGet(&(stream->state)) != STREAM_DONE)))
+        {
+            continue;
+        }
+
+        SDL_AtomicSet(&(stream->stop), 1);
+        SDL_SemPost(stream->wake);
+        SDL_WaitThread(stream->thread, NULL);
+        SDL_DestroySemaphore(stream->wake);
+        SDL_FreeAudioStream(stream->convert);
+        SDL_RWclose(stream->file);
+        free(stream->filename);
+        stream->filename = NULL;
+        SDL_AtomicSet(&(stream->state), STREAM_FREE);
+    }
+}
+
+static AudioHandle playStream(const char * filename, int volume, CommandType type, int32_t gainStep)
+{
+    Command command;
+    Stream * stream = NULL;
+    uint8_t opened = 0;
+    int i;
+
+    if(gDevice == NULL || !gDevice->audioEnabled || filename == NULL)
+    {
+        return 0;
+    }
+
+    closeStreams(0);
+
+    /* Carry on with the same music if it is still playing */
+    for(i = 0; i < AUDIO_MAX_MUSIC && type == COMMAND_CROSSFADE && stream == NULL; i++)
+    {
+        if(SDL_AtomicGet(&gStreams[i].state) == STREAM_PLAYING && strcmp(gStreams[i].filename, filename) == 0)
+        {
+            stream = &gStreams[i];
+        }
+    }
+
+    if(stream == NULL)
+    {
+        stream = openStream(filename);
+        opened = 1;
+    }
+
+    if(stream == NULL)
+    {
+        return 0;
+    }
+
+    command.type = type;
+    command.handle = 0;
+    command.sound = NULL;
+    command.stream = stream;
+    command.loop = 1;
+    command.volume = volume < 0 ? 0 : volume > SDL_MIX_MAXVOLUME ? SDL_MIX_MAXVOLUME : volume;
+    command.gainStep = gainStep;
+
+    SDL_AtomicAdd(&(stream->pending), 1);
+
+    if(sendCommand(&command) == 0)
+    {
+        /* Nothing will ever play a stream that was just opened */
+        if(opened)
+        {
+            SDL_AtomicSet(&(stream->state), STREAM_DONE);
+        }
+
+        SDL_AtomicAdd(&(stream->pending), -1);
+        return 0;
+    }
+
+    return command.handle;
+}
+
+static inline AudioHandle playAudio(const char * filename, Audio * audio, uint8_t loop, int volume)
+{
+    Command command;
+
+    /* Check if audio is enabled */
+    if(gDevice == NULL || !gDevice->audioEnabled)
+    {
+        return 0;
+    }
+
+    /* Load from filename or from Memory */
+    if(filename != NULL)
+    {
+        audio = getCachedAudio(filename, loop);
+    }
+    else if(audio == NULL)
     {
         fprintf(stderr, "[%s: %d]Warning: filename and Audio parameters NULL\n", __FILE__, __LINE__);
-        return;
+        return 0;
     }
 
-    /* Lock callback function */
-    SDL_LockAudioDevice(gDevice->device);
+    if(audio == NULL || !matchesDevice(audio))
+    {
+        return 0;
+    }
+
+    command.type = COMMAND_PLAY;
+    command.handle = 0;
+    command.sound = audio;
+    command.stream = NULL;
+    command.loop = loop;
+    command.volume = volume < 0 ? 0 : volume > SDL_MIX_MAXVOLUME ? SDL_MIX_MAXVOLUME : volume;
+    command.gainStep = 0;
+
+    return sendCommand(&command);
+}
+
+static int32_t gainStepFor(uint32_t fadeMs)
+{
+    uint64_t frames = (uint64_t) fadeMs * (gDevice->have).freq / 1000;
 
-    if(loop == 1)
+    if(frames == 0)
     {
-        addMusic((Audio *) (gDevice->want).userdata, newAudio);
+        return MIX_VOLUME_GAIN(SDL_MIX_MAXVOLUME);
     }
-    else
+
+    return MIX_VOLUME_GAIN(SDL_MIX_MAXVOLUME) / frames + 1;
+}
+
+static AudioHandle sendCommand(Command * command)
+{
+    int tail = SDL_AtomicGet(&gCommandTail);
+
+    /* Full, the callback hasn't caught up */
+    if(tail - SDL_AtomicGet(&gCommandHead) >= AUDIO_MAX_COMMANDS)
+    {
+        return 0;
+    }
+
+    if(command->handle == 0)
     {
-        addAudio((Audio *) (gDevice->want).userdata, newAudio);
+        command->handle = gNextHandle;
+        gNextHandle = gNextHandle == UINT32_MAX ? 1 : gNextHandle + 1;
     }
 
-    SDL_UnlockAudioDevice(gDevice->device);
+    gCommands[tail & (AUDIO_MAX_COMMANDS - 1)] = *command;
+
+    /* Publish the command only once it is completely written */
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&gCommandTail, tail + 1);
+
+    return command->handle;
+}
+
+static void runCommands(void)
+{
+    int head = SDL_AtomicGet(&gCommandHead);
+    int tail = SDL_AtomicGet(&gCommandTail);
+    const Command * command;
+    Voice * voice;
+    uint8_t found;
+    int i;
+
+    SDL_MemoryBarrierAcquire();
+
+    for(; head != tail; head++)
+    {
+        command = &gCommands[head & (AUDIO_MAX_COMMANDS - 1)];
+
+        switch(command->type)
+        {
+            case COMMAND_PLAY:
+                if(command->loop == 1)
+                {
+                    fadeOutMusic(0);
+                }
+
+                /* If under max number of voices allowed, else don't play */
+                voice = findFreeVoice(command->loop);
+
+                if(voice != NULL)
+                {
+                    voice->sound = command->sound;
+                    voice->stream = command->stream;
+                    voice->handle = command->handle;
+                    voice->offset = 0;
+                    voice->loop = command->loop;
+                    voice->fade = 0;
+                    voice->crossfade = 0;
+                    voice->gain = MIX_VOLUME_GAIN(command->volume);
+                    voice->gainTarget = voice->gain;
+                    voice->gainStep = 0;
+                    voice->active = 1;
+                }
+                else if(command->stream != NULL)
+                {
+                    SDL_AtomicSet(&(command->stream->state), STREAM_DONE);
+                }
+                break;
 
+            case COMMAND_CROSSFADE:
+                found = 0;
+
+                for(i = 0; i < AUDIO_MAX_VOICES; i++)
+                {
+                    voice = &gVoices[i];
+
+                    if(!voice->active || voice->loop == 0)
+                    {
+                        continue;
+                    }
+
+                    /* Keep the same music playing, fading back in if it was on its way out */
+                    if((command->sound != NULL || command->stream != NULL) && !found && voice->sound == command->sound && voice->stream == command->stream)
+                    {
+                        found = 1;
+                        voice->handle = command->handle;
+                        voice->fade = 0;
+                        voice->crossfade = 1;
+                        voice->gainTarget = MIX_VOLUME_GAIN(command->volume);
+                        voice->gainStep = command->gainStep;
+                    }
+                    else
+                    {
+                        voice->fade = 1;
+                        voice->gainTarget = 0;
+                        voice->gainStep = command->gainStep;
+                    }
+                }
+
+                voice = ((command->sound != NULL || command->stream != NULL) && !found) ? findFreeVoice(1) : NULL;
+
+                if(voice != NULL)
+                {
+                    voice->sound = command->sound;
+                    voice->stream = command->stream;
+                    voice->handle = command->handle;
+                    voice->offset = 0;
+                    voice->loop = 1;
+                    voice->fade = 0;
+                    /* Start silent and play alongside the old music instead of waiting for it to fade out */
+                    voice->gain = 0;
+                    voice->crossfade = 1;
+                    voice->gainTarget = MIX_VOLUME_GAIN(command->volume);
+                    voice->gainStep = command->gainStep;
+                    voice->active = 1;
+
+                    /* The stream may have finished fading out since this was sent */
+                    if(command->stream != NULL)
+                    {
+                        SDL_AtomicSet(&(command->stream->state), STREAM_PLAYING);
+                    }
+                }
+                else if(command->stream != NULL && !found)
+                {
+                    SDL_AtomicSet(&(command->stream->state), STREAM_DONE);
+                }
+                break;
+
+            case COMMAND_STOP:
+                if((voice = findVoice(command->handle)) != NULL)
+                {
+                    stopVoice(voice);
+                }
+                break;
+
+            case COMMAND_VOLUME:
+                if((voice = findVoice(command->handle)) != NULL)
+                {
+                    voice->gainTarget = MIX_VOLUME_GAIN(command->volume);
+                    voice->gainStep = command->gainStep;
+
+                    if(command->gainStep == 0)
+                    {
+                        voice->gain = voice->gainTarget;
+                    }
+                }
+                break;
+
+            case COMMAND_FADE_OUT:
+                if((voice = findVoice(command->handle)) != NULL)
+                {
+                    voice->fade = 1;
+                    voice->gainTarget = 0;
+                    voice->gainStep = command->gainStep;
+                }
+                break;
+        }
+
+        /* The game thread can close the stream once nothing refers to it */
+        if(command->stream != NULL)
+        {
+            SDL_AtomicAdd(&(command->stream->pending), -1);
+        }
+    }
+
+    SDL_AtomicSet(&gCommandHead, head);
+}
+
+static void stopVoice(Voice * voice)
+{
+    voice->active = 0;
+
+    if(voice->stream != NULL)
+    {
+        SDL_AtomicSet(&(voice->stream->state), STREAM_DONE);
+    }
 }
 
-static void addMusic(Audio * root, Audio * newAudio)
+static void fadeOutMusic(int32_t step)
 {
     uint8_t musicFound = 0;
-    Audio * rootNext = root->next;
+    int i;
 
-    /* Find any existing musics, 0, 1 or 2 and fade them out */
-    while(rootNext != NULL)
+    step = step == 0 ? gainStepFor(AUDIO_MUSIC_FADE_MS) : step;
+
+    /* Set flag to remove any queued up music in favour of new music */
+    for(i = 0; i < AUDIO_MAX_VOICES; i++)
     {
-        /* Phase out any current music */
-        if(rootNext->loop == 1 && rootNext->fade == 0)
+        if(gVoices[i].active && gVoices[i].loop == 1 && gVoices[i].fade == 1)
+        {
+            musicFound = 1;
+        }
+    }
+
+    /* Phase out any current music */
+    for(i = 0; i < AUDIO_MAX_VOICES; i++)
+    {
+        if(gVoices[i].active && gVoices[i].loop == 1 && gVoices[i].fade == 0)
         {
             if(musicFound)
             {
-                rootNext->length = 0;
-                rootNext->volume = 0;
+                stopVoice(&gVoices[i]);
             }
 
-            rootNext->fade = 1;
+            gVoices[i].fade = 1;
+            gVoices[i].gainTarget = 0;
+            gVoices[i].gainStep = step;
+        }
+    }
+}
+
+static Voice * findFreeVoice(uint8_t loop)
+{
+    Voice * freeVoice = NULL;
+    uint32_t count = 0;
+    int i;
+
+    for(i = 0; i < AUDIO_MAX_VOICES; i++)
+    {
+        if(!gVoices[i].active)
+        {
+            freeVoice = freeVoice == NULL ? &gVoices[i] : freeVoice;
         }
-        /* Set flag to remove any queued up music in favour of new music */
-        else if(rootNext->loop == 1 && rootNext->fade == 1)
+        else if(gVoices[i].loop == loop)
         {
-            musicFound = 1;
+            count++;
         }
+    }
 
-        rootNext = rootNext->next;
+    if(count >= (loop ? AUDIO_MAX_MUSIC : AUDIO_MAX_SOUNDS))
+    {
+        return NULL;
     }
 
-    addAudio(root, newAudio);
+    return freeVoice;
 }
 
-static inline void audioCallback(void * userdata, uint8_t * stream, int len)
+static Voice * findVoice(AudioHandle handle)
 {
-    Audio * audio = (Audio *) userdata;
-    Audio * previous = audio;
-    int tempLength;
-    uint8_t music = 0;
+    int i;
 
-    /* Silence the main buffer */
-    SDL_memset(stream, 0, len);
+    for(i = 0; i < AUDIO_MAX_VOICES; i++)
+    {
+        if(gVoices[i].active && gVoices[i].handle == handle)
+        {
+            return &gVoices[i];
+        }
+    }
 
-    /* First one is place holder */
-    audio = audio->next;
+    return NULL;
+}
 
-    while(audio != NULL)
+static void mixVoice(Voice * voice, int32_t * acc, uint32_t frames, uint32_t channels)
+{
+    Stream * stream = voice->stream;
+    uint32_t frameSize = channels * sizeof(int16_t);
+    const uint8_t * source;
+    uint32_t count;
+    uint32_t available;
+    uint32_t rampFrames;
+    int32_t step;
+    uint8_t ramped;
+
+    while(frames > 0 && voice->active)
     {
-        if(audio->length > 0)
+        if(stream != NULL)
         {
-            if(audio->fade == 1 && audio->loop == 1)
+            /* Whole frames read in and not yet played, up to the end of the ring buffer */
+            available = SDL_AtomicGet(&(stream->available));
+            SDL_MemoryBarrierAcquire();
+
+            count = available > AUDIO_STREAM_BUFFER - stream->readIndex ? AUDIO_STREAM_BUFFER - stream->readIndex : available;
+            count /= frameSize;
+
+            if(count == 0)
             {
-                music = 1;
+                /* The reader thread has fallen behind, play silence */
+                SDL_AtomicAdd(&gUnderruns, 1);
+                break;
+            }
+
+            source = stream->buffer + stream->readIndex;
+        }
+        else
+        {
+            /* Whole frames left before the end of the sound */
+            count = (voice->sound->length - voice->offset) / frameSize;
 
-                if(audio->volume > 0)
+            if(count == 0)
+            {
+                /* Musics loop straight back to the start within the same buffer */
+                if(voice->loop == 1 && voice->fade == 0 && voice->sound->length >= frameSize)
                 {
-                    if(audio->volume - AUDIO_MUSIC_FADE_VALUE < 0)
-                    {
-                        audio->volume = 0;
-                    }
-                    else
-                    {
-                        audio->volume -= AUDIO_MUSIC_FADE_VALUE;
-                    }
+                    voice->offset = 0;
                 }
                 else
                 {
-                    audio->length = 0;
+                    stopVoice(voice);
                 }
+
+                continue;
             }
 
-            if(music && audio->loop == 1 && audio->fade == 0)
+            source = voice->sound->buffer + voice->offset;
+        }
+
+        count = count > frames ? frames : count;
+        step = 0;
+        ramped = 0;
+
+        /* Ramp the gain a little every frame, only until it reaches its target */
+        if(voice->gain != voice->gainTarget)
+        {
+            if(voice->gainStep == 0)
             {
-                tempLength = 0;
+                voice->gain = voice->gainTarget;
             }
             else
             {
-                tempLength = ((uint32_t) len > audio->length) ? audio->length : (uint32_t) len;
-            }
+                step = voice->gain < voice->gainTarget ? voice->gainStep : -voice->gainStep;
+                rampFrames = ((uint32_t) abs(voice->gainTarget - voice->gain) + voice->gainStep - 1) / voice->gainStep;
 
-            SDL_MixAudioFormat(stream, audio->buffer, AUDIO_FORMAT, tempLength, audio->volume);
+                if(rampFrames <= count)
+                {
+                    count = rampFrames;
+                    ramped = 1;
+                }
+            }
+        }
 
-            audio->buffer += tempLength;
-            audio->length -= tempLength;
+        voice->gain = mix_add(acc, (const int16_t *) source, count, channels, voice->gain, step);
 
-            previous = audio;
-            audio = audio->next;
+        if(ramped)
+        {
+            voice->gain = voice->gainTarget;
         }
-        else if(audio->loop == 1 && audio->fade == 0)
+
+        acc += count * channels;
+        frames -= count;
+
+        if(stream != NULL)
         {
-            audio->buffer = audio->bufferTrue;
-            audio->length = audio->lengthTrue;
+            stream->readIndex = (stream->readIndex + count * frameSize) % AUDIO_STREAM_BUFFER;
+            SDL_AtomicAdd(&(stream->available), -(int) (count * frameSize));
         }
         else
         {
-            previous->next = audio->next;
+            voice->offset += count * frameSize;
+        }
+
+        /* Finished fading out */
+        if(voice->fade == 1 && voice->gain == 0)
+        {
+            stopVoice(voice);
+        }
+    }
+
+    /* Let the reader thread fill the space just played */
+    if(stream != NULL)
+    {
+        SDL_SemPost(stream->wake);
+    }
+}
+
+static inline void audioCallback(void * userdata, uint8_t * stream, int len)
+{
+    uint64_t start = SDL_GetPerformanceCounter();
+    uint64_t elapsed;
+    uint32_t elapsedUs;
+    uint32_t channels = (gDevice->have).channels;
+    uint32_t frames = len / (channels * sizeof(int16_t));
+    uint32_t deadlineUs = (uint64_t) frames * 1000000 / (gDevice->have).freq;
+    uint32_t chunk;
+    uint8_t music = 0;
+    int i;
+
+    (void) userdata;
+
+    runCommands();
+
+    /* Music queued with playMusic waits for any music fading out before it */
+    for(i = 0; i < AUDIO_MAX_VOICES; i++)
+    {
+        if(gVoices[i].active && gVoices[i].loop == 1 && gVoices[i].fade == 1 && !gVoices[i].crossfade)
+        {
+            music = 1;
+        }
+    }
+
+    /* Add up every voice at full precision, then clip once */
+    while(frames > 0)
+    {
+        chunk = frames > AUDIO_MIX_FRAMES ? AUDIO_MIX_FRAMES : frames;
+
+        SDL_memset(gMix, 0, chunk * channels * sizeof(int32_t));
 
-            if(audio->loop == 0)
+        for(i = 0; i < AUDIO_MAX_VOICES; i++)
+        {
+            if(!gVoices[i].active || (music && gVoices[i].loop == 1 && gVoices[i].fade == 0 && !gVoices[i].crossfade))
             {
-                gSoundCount--;
+                continue;
             }
 
-            audio->next = NULL;
-            freeAudio(audio);
-
-            audio = previous->next;
+            mixVoice(&gVoices[i], gMix, chunk, channels);
         }
+
+        mix_store((int16_t *) stream, gMix, chunk * channels);
+
+        stream += chunk * channels * sizeof(int16_t);
+        len -= chunk * channels * sizeof(int16_t);
+        frames -= chunk;
     }
-}
 
-static void addAudio(Audio * root, Audio * newAudio)
-{
-    if(root == NULL)
+    /* Silence any partial frame left over */
+    SDL_memset(stream, 0, len);
+
+    /* Taking longer than the buffer lasts means the device will run dry */
+    elapsed = SDL_GetPerformanceCounter() - start;
+    elapsedUs = elapsed * 1000000 / SDL_GetPerformanceFrequency();
+    gTotalCallbackTime += elapsedUs;
+
+    SDL_AtomicAdd(&gCallbacks, 1);
+
+    if(elapsedUs > deadlineUs)
     {
-        return;
+        SDL_AtomicAdd(&gOverruns, 1);
     }
 
-    while(root->next != NULL)
+    if(elapsedUs > (uint32_t) SDL_AtomicGet(&gWorstUs))
     {
-        root = root->next;
+        SDL_AtomicSet(&gWorstUs, elapsedUs);
     }
 
-    root->next = newAudio;
+    SDL_AtomicSet(&gAverageUs, gTotalCallbackTime / SDL_AtomicGet(&gCallbacks));
 }
@@ -34,27 +34,45 @@ extern "C"
 #include <SDL2/SDL.h>
 
 /*
- * Queue structure for all loaded sounds
+ * Identifies one playing sound, 0 is never a valid handle
+ *
+ */
+typedef uint32_t AudioHandle;
+
+/*
+ * How the audio callback is keeping up, see getAudioStats()
+ *
+ */
+typedef struct audioStats
+{
+    uint32_t frequency;
+    uint32_t channels;
+    uint32_t samples;
+    uint32_t deadlineUs;
+    uint32_t callbacks;
+    uint32_t overruns;
+    uint32_t worstUs;
+    uint32_t averageUs;
+    uint32_t underruns;
+} AudioStats;
+
+/*
+ * A loaded sound, its samples are shared by every voice playing it and never change after loading
  *
  */
 typedef struct sound
 {
     uint32_t length;
-    uint32_t lengthTrue;
-    uint8_t * bufferTrue;
     uint8_t * buffer;
     uint8_t loop;
-    uint8_t fade;
-    uint8_t free;
     uint8_t volume;
 
     SDL_AudioSpec audio;
-
-    struct sound * next;
 } Audio;
 
 /*
  * Create a Audio object
+ * Call after initAudio(), the sound is converted to the device's rate and channels once here so it can be mixed as is
  *
  * @param filename      Filename for the WAVE file to load
  * @param loop          0 ends after playing once (sound), 1 repeats and fades when other music added (music)
@@ -66,30 +84,41 @@ typedef struct sound
 Audio * createAudio(const char * filename, uint8_t loop, int volume);
 
 /*
- * Frees as many chained Audios as given
+ * Frees an Audio, it must not be playing (call endAudio() first)
  *
- * @param audio     Chain of sounds to free
+ * @param audio     Sound to free
  *
  */
 void freeAudio(Audio * audio);
 
 /*
- * Play a wave file currently must be S16LE format 2 channel stereo
+ * The play, stop and volume functions below never block or wait for the audio thread,
+ * they queue a command that the next audio callback carries out. They must all be
+ * called from the same thread. Each returns a handle to the sound or 0 if it can't be
+ * played (audio is not enabled or the command queue is full). If there are already
+ * too many sounds playing the handle is valid but the sound is never heard.
+ *
+ */
+
+/*
+ * Play a wave file, converted to the device's rate and channels when loaded
+ * The file is loaded the first time it is played and kept until endAudio()
  *
  * @param filename      Filename to open, use getAbsolutePath
  * @param volume        Volume 0 - 128. SDL_MIX_MAXVOLUME constant for max volume
  *
  */
-void playSound(const char * filename, int volume);
+AudioHandle playSound(const char * filename, int volume);
 
 /*
  * Plays a new music, only 1 at a time plays
+ * The file is streamed from disk as it plays, it must be 16 bit PCM and is converted to the device's rate and channels as it is read
  *
- * @param filename      Filename of the WAVE file to load
+ * @param filename      Filename of the WAVE file to stream
  * @param volume        Volume read playSound for moree
  *
  */
-void playMusic(const char * filename, int volume);
+AudioHandle playMusic(const char * filename, int volume);
 
 /*
  * Plays a sound from a createAudio object (clones), only 1 at a time plays
@@ -99,7 +128,7 @@ void playMusic(const char * filename, int volume);
  * @param volume        Volume read playSound for moree
  *
  */
-void playSoundFromMemory(Audio * audio, int volume);
+AudioHandle playSoundFromMemory(Audio * audio, int volume);
 
 /*
  * Plays a music from a createAudio object (clones), only 1 at a time plays
@@ -109,7 +138,61 @@ void playSoundFromMemory(Audio * audio, int volume);
  * @param volume        Volume read playSound for moree
  *
  */
-void playMusicFromMemory(Audio * audio, int volume);
+AudioHandle playMusicFromMemory(Audio * audio, int volume);
+
+/*
+ * Crossfades from the current music to a createAudio object (clones), the new music fading in while the old fades out
+ * If the music is already playing it carries on from where it is, so it can be called on every state change
+ *
+ * @param audio         Audio object to clone and use, or NULL to fade out to silence
+ * @param volume        Volume read playSound for moree
+ * @param fadeMs        Length of the crossfade in milliseconds
+ *
+ * @return returns a handle to the music, 0 if fading to silence or audio is not enabled
+ *
+ */
+AudioHandle crossfadeMusicFromMemory(Audio * audio, int volume, uint32_t fadeMs);
+
+/*
+ * Crossfades from the current music to a WAVE file streamed from disk, see crossfadeMusicFromMemory
+ * A reader thread keeps a small buffer of the file filled as it plays, so it starts straight away
+ * and never has to be loaded whole. It must be 16 bit PCM, the reader thread converts it to the device's rate and channels
+ *
+ * @param filename      Filename of the WAVE file to stream
+ * @param volume        Volume read playSound for moree
+ * @param fadeMs        Length of the crossfade in milliseconds
+ *
+ * @return returns a handle to the music, 0 on failure
+ *
+ */
+AudioHandle crossfadeMusicStream(const char * filename, int volume, uint32_t fadeMs);
+
+/*
+ * Stop a sound or music straight away
+ *
+ * @param handle        Handle returned when it was played, does nothing if it has already finished
+ *
+ */
+void stopAudio(AudioHandle handle);
+
+/*
+ * Change the volume of a sound or music
+ *
+ * @param handle        Handle returned when it was played
+ * @param volume        New volume, read playSound for moree
+ * @param fadeMs        Time to take to reach the new volume in milliseconds, 0 for straight away
+ *
+ */
+void setAudioVolume(AudioHandle handle, int volume, uint32_t fadeMs);
+
+/*
+ * Fade out a sound or music then stop it
+ *
+ * @param handle        Handle returned when it was played
+ * @param fadeMs        Length of the fade in milliseconds
+ *
+ */
+void fadeOutAudio(AudioHandle handle, uint32_t fadeMs);
 
 /*
  * Free all audio related variables
@@ -124,6 +207,43 @@ void endAudio(void);
  */
 void initAudio(void);
 
+/*
+ * Initialize Audio Variable without opening an audio device, so the mixer can run with no sound card
+ * Everything is mixed at the rate and channels a device is asked for (see getAudioStats), only when renderAudio() is called
+ *
+ */
+void initAudioOffline(void);
+
+/*
+ * Run the audio callback once, only after initAudioOffline()
+ * Streamed music is read first rather than by reader threads, so the result is the same every run
+ *
+ * @param buffer        Buffer to mix into
+ * @param length        Length of buffer in bytes, a whole number of frames
+ *
+ */
+void renderAudio(uint8_t * buffer, int length);
+
+/*
+ * Set the number of frames in each buffer the audio callback fills, call before initAudio()
+ * Smaller buffers mean sounds start sooner after being played but the callback runs more often
+ *
+ * @param samples       Frames per buffer, a power of 2 (default 4096)
+ *
+ */
+void setAudioBufferSize(uint16_t samples);
+
+/*
+ * Get counters for the audio callback since initAudio()
+ *
+ * @param stats         Filled in with the device's rate and channels, the buffer size in frames and how long a buffer lasts (deadlineUs),
+ *                      the number of callbacks, how many took longer than the deadline (overruns),
+ *                      the worst and average time a callback took, in microseconds, and how many
+ *                      times streamed music wasn't read in time (underruns)
+ *
+ */
+void getAudioStats(AudioStats * stats);
+
 /*
  * Pause audio from playing
  *
@@ -0,0 +1,281 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "batch.h"
+#include "world.h"
+#include "bot.h"
+#include "rng.h"
+
+#define MAX_THREADS 256
+// Keep each worker's range on its own cache line so taking a game never
+// slows down another worker
+#define CACHE_LINE 64
+
+// One thread of the pool. Each owns a range of game indices, taking games from
+// the front, and steals half of another worker's range from the back when it
+// runs out. Nothing else is shared: results are kept per worker and each game
+// only writes its own entries of the survival and coins arrays.
+typedef struct Worker {
+    // Games left, begin in the low 32 bits and end (exclusive) in the high 32,
+    // so the owner and thieves can update it with one compare-and-swap
+    uint64_t range __attribute__((aligned(CACHE_LINE)));
+    int index;
+    struct Batch* batch;
+    GameWorld* world;
+    unsigned long games, won, timedOut, ticks, finishedTicks, coins, steals;
+    double seconds;
+} Worker;
+
+typedef struct Batch {
+    BatchConfig const* config;
+    Worker* workers;
+    int numWorkers;
+    // Ticks each game lasted (NOT_FINISHED if it was stopped at maxTicks) and
+    // coins it collected, indexed by game
+    uint32_t* survival;
+    uint32_t* coins;
+} Batch;
+
+// Length of a game stopped at maxTicks, which sorts after every real length
+#define NOT_FINISHED UINT32_MAX
+
+static uint64_t pack_range(uint32_t begin, uint32_t end) {
+    return (uint64_t)end << 32 | begin;
+}
+
+// Take the next game from the front of the worker's own range, -1 if empty
+static long take_game(Worker* worker) {
+    uint64_t range = __atomic_load_n(&worker->range, __ATOMIC_ACQUIRE);
+    while (1)
+    {
+        uint32_t begin = (uint32_t)range, end = range >> 32;
+        if (begin >= end)
+            return -1;
+        if (__atomic_compare_exchange_n(&worker->range, &range, pack_range(begin + 1, end), true,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return begin;
+    }
+}
+
+// Move the back half of another worker's range into this worker's (empty)
+// range. Returns false once every other worker has run out.
+static bool steal_games(Worker* thief) {
+    Batch* batch = thief->batch;
+    for (int k = 1; k < batch->numWorkers; k++)
+    {
+        Worker* victim = &batch->workers[(thief->index + k) % batch->numWorkers];
+        uint64_t range = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+        while (1)
+        {
+            uint32_t begin = (uint32_t)range, end = range >> 32;
+            if (begin >= end)
+                break;
+            uint32_t middle = begin + (end - begin) / 2;
+            if (__atomic_compare_exchange_n(&victim->range, &range, pack_range(begin, middle), true,
+                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                // Nobody steals from an empty range, so this can't race
+                __atomic_store_n(&thief->range, pack_range(middle, end), __ATOMIC_RELEASE);
+                thief->steals++;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void run_game(Worker* worker, unsigned long game) {
+    BatchConfig const* config = worker->batch->config;
+    GameWorld* world = worker->world;
+    float stepMs = 1000.0f / config->tickRate;
+    uint64_t seed = game == 0 ? config->seed : rng_hash(config->seed, game);
+
+    world->endless = config->endless;
+    world->params = config->params;
+    world->seed = seed;
+    world_setup(world);
+    Bot bot;
+    bot_init(&bot, config->policy, rng_hash(seed, UINT64_MAX));
+    Keys keys;
+    unsigned long ticks = 0;
+    uint32_t coins = 0;
+    while (world->state == STATE_CONTINUE && ticks < config->maxTicks)
+    {
+        bot_keys(&bot, world, &keys);
+        world_step(world, &keys, stepMs);
+        coins += world->events.coinsCollected;
+        ticks++;
+    }
+
+    worker->games++;
+    worker->ticks += ticks;
+    if (world->state == STATE_GAME_OVER_WON)
+        worker->won++;
+    else if (world->state == STATE_CONTINUE)
+        worker->timedOut++;
+    worker->coins += coins;
+    if (world->state != STATE_CONTINUE)
+        worker->finishedTicks += ticks;
+    worker->batch->survival[game] = world->state == STATE_CONTINUE ? NOT_FINISHED : ticks;
+    worker->batch->coins[game] = coins;
+}
+
+static int worker_main(void* data) {
+    Worker* worker = data;
+    uint64_t start = SDL_GetPerformanceCounter();
+    while (1)
+    {
+        long game = take_game(worker);
+        if (game >= 0)
+            run_game(worker, game);
+        else if (!steal_games(worker))
+            break;
+    }
+    worker->seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    return 0;
+}
+
+static int compare_uint32(void const* a, void const* b) {
+    uint32_t x = *(uint32_t const*)a, y = *(uint32_t const*)b;
+    return (x > y) - (x < y);
+}
+
+// Value the given fraction of the way through n sorted values
+static uint32_t percentile(uint32_t const* sorted, unsigned long n, double fraction) {
+    return sorted[(unsigned long)(fraction * (n - 1))];
+}
+
+// Length in seconds of the game the given fraction of the way through the
+// sorted lengths of the finished games, which come first
+static double length_percentile(Batch const* batch, unsigned long finished, double fraction) {
+    return (double)percentile(batch->survival, finished, fraction) / batch->config->tickRate;
+}
+
+static void print_results(Batch* batch, double seconds, int numThreads) {
+    BatchConfig const* config = batch->config;
+    unsigned long games = 0, won = 0, timedOut = 0, ticks = 0, finishedTicks = 0, coins = 0, steals = 0;
+    double busiest = 0, idlest = seconds;
+    for (int i = 0; i < numThreads; i++)
+    {
+        Worker const* worker = &batch->workers[i];
+        games += worker->games;
+        won += worker->won;
+        timedOut += worker->timedOut;
+        ticks += worker->ticks;
+        finishedTicks += worker->finishedTicks;
+        coins += worker->coins;
+        steals += worker->steals;
+        if (worker->seconds > busiest)
+            busiest = worker->seconds;
+        if (worker->seconds < idlest)
+            idlest = worker->seconds;
+    }
+    qsort(batch->survival, config->games, sizeof(uint32_t), compare_uint32);
+    qsort(batch->coins, config->games, sizeof(uint32_t), compare_uint32);
+
+    printf("%lu games: %lu won (%.1f%%), %lu lost, %lu stopped after %.0f s\n", games, won,
+        100.0 * won / games, games - won - timedOut, timedOut, (double)config->maxTicks / config->tickRate);
+    // Games stopped at maxTicks didn't really last that long, so only the
+    // finished ones go into the lengths
+    unsigned long finished = games - timedOut;
+    if (finished > 0)
+        printf("Length of the %lu finished games: %.1f s mean, %.1f s min, %.1f / %.1f / %.1f s at 10/50/90%%, %.1f s max\n",
+            finished, (double)finishedTicks / finished / config->tickRate, length_percentile(batch, finished, 0),
+            length_percentile(batch, finished, 0.1), length_percentile(batch, finished, 0.5),
+            length_percentile(batch, finished, 0.9), length_percentile(batch, finished, 1));
+    else
+        printf("No game finished\n");
+    // Separates settings even when few games are won
+    printf("Coins collected: %.1f mean, %u / %u / %u at 10/50/90%%, %u max",
+        (double)coins / games, percentile(batch->coins, config->games, 0.1),
+        percentile(batch->coins, config->games, 0.5), percentile(batch->coins, config->games, 0.9),
+        percentile(batch->coins, config->games, 1));
+    if (config->endless)
+        printf("\n");
+    else
+        printf(" (of %d)\n", NUM_COINS);
+    printf("%lu ticks in %.3f s on %d threads (%.0f ticks/s, %.0f per thread), %lu steals, threads busy %.3f-%.3f s\n",
+        ticks, seconds, numThreads, ticks / seconds, ticks / seconds / numThreads, steals,
+        idlest, busiest);
+}
+
+bool batch_run(BatchConfig const* config) {
+    Batch batch;
+    batch.config = config;
+    if (config->games == 0 || config->games > UINT32_MAX)
+    {
+        fprintf(stderr, "Batch must have 1 to %lu games\n", (unsigned long)UINT32_MAX);
+        return false;
+    }
+    // Game lengths are kept as 32 bits, with the largest value meaning stopped
+    if (config->maxTicks == 0 || config->maxTicks >= NOT_FINISHED)
+    {
+        fprintf(stderr, "Batch games must be stopped after 1 to %lu ticks\n", (unsigned long)NOT_FINISHED - 1);
+        return false;
+    }
+    batch.numWorkers = config->threads > 0 ? config->threads : SDL_GetCPUCount();
+    if (batch.numWorkers > MAX_THREADS)
+        batch.numWorkers = MAX_THREADS;
+    if ((unsigned long)batch.numWorkers > config->games)
+        batch.numWorkers = config->games;
+
+    batch.survival = malloc(sizeof(uint32_t) * config->games);
+    batch.coins = malloc(sizeof(uint32_t) * config->games);
+    void* workers;
+    batch.workers = posix_memalign(&workers, CACHE_LINE, sizeof(Worker) * batch.numWorkers) == 0 ? workers : NULL;
+    SDL_Thread* threads[MAX_THREADS];
+    bool ok = batch.survival && batch.coins && batch.workers;
+    int numThreads = 0;
+    if (ok)
+    {
+        // Share the games out evenly to start with
+        memset(batch.workers, 0, sizeof(Worker) * batch.numWorkers);
+        for (int i = 0; i < batch.numWorkers; i++)
+        {
+            Worker* worker = &batch.workers[i];
+            worker->index = i;
+            worker->batch = &batch;
+            worker->range = pack_range(config->games * i / batch.numWorkers,
+                config->games * (i + 1) / batch.numWorkers);
+            worker->world = world_create();
+            ok = ok && worker->world;
+        }
+    }
+
+    uint64_t start = SDL_GetPerformanceCounter();
+    // Worker 0 runs on this thread
+    for (int i = 1; ok && i < batch.numWorkers; i++)
+    {
+        threads[i] = SDL_CreateThread(worker_main, "batch", &batch.workers[i]);
+        if (!threads[i])
+        {
+            fprintf(stderr, "Error creating thread: %s\n", SDL_GetError());
+            // Threads already started finish the games between them
+            break;
+        }
+        numThreads = i;
+    }
+    if (ok)
+    {
+        worker_main(&batch.workers[0]);
+        for (int i = 1; i <= numThreads; i++)
+            SDL_WaitThread(threads[i], NULL);
+        double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+        print_results(&batch, seconds, numThreads + 1);
+    }
+    else
+    {
+        fprintf(stderr, "Error allocating batch\n");
+    }
+
+    for (int i = 0; batch.workers && i < batch.numWorkers; i++)
+        world_destroy(batch.workers[i].world);
+    free(batch.workers);
+    free(batch.survival);
+    free(batch.coins);
+    return ok;
+}
@@ -0,0 +1,32 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "world.h"
+#include "bot.h"
+
+// A batch of independent headless games, for tuning difficulty
+typedef struct BatchConfig {
+    unsigned long games;
+    // Longest a game may run before it is stopped, in ticks (under 2^32 - 1)
+    unsigned long maxTicks;
+    unsigned int tickRate;
+    // Game 0 uses this seed and game n rng_hash(seed, n), as in a seeded session
+    uint64_t seed;
+    bool endless;
+    WorldParams params;
+    BotPolicy policy;
+    // Threads to run games on, 0 for one per CPU
+    int threads;
+} BatchConfig;
+
+// Run every game of the batch across a pool of threads and print the win
+// rate, how long games lasted, how many coins they collected and how many
+// ticks per second were simulated.
+// Results are the same however many threads there are. Returns false if the
+// threads or worlds couldn't be created.
+bool batch_run(BatchConfig const* config);
+
+#endif
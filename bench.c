@@ -0,0 +1,534 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "bench.h"
+#include "audio.h"
+#include "mixer.h"
+#include "rng.h"
+#include "world.h"
+#include "rect.h"
+#include "evader.h"
+
+// Mixer benchmark: as many voices as audio.c can play at once, each long
+// enough for one full audio buffer
+#define BENCH_VOICES 25
+#define BENCH_FRAMES 4096
+#define BENCH_CHANNELS 2
+#define BENCH_BUFFERS 2000
+
+static double seconds_since(uint64_t start) {
+    return (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+}
+
+// Mix BENCH_VOICES voices with SDL_MixAudioFormat (one clip per voice, as
+// audio.c used to) and with mix_add/mix_store (with half the voices fading)
+static void bench_mixer(void) {
+    int samples = BENCH_FRAMES * BENCH_CHANNELS;
+    int16_t* voices = malloc(sizeof(int16_t) * samples * BENCH_VOICES);
+    int16_t* out = malloc(sizeof(int16_t) * samples);
+    int32_t* acc = malloc(sizeof(int32_t) * samples);
+    if (!voices || !out || !acc)
+    {
+        fprintf(stderr, "Error allocating mixer benchmark buffers\n");
+        exit(EXIT_FAILURE);
+    }
+    Rng rng;
+    rng_seed(&rng, 1);
+    for (int i = 0; i < samples * BENCH_VOICES; i++)
+        voices[i] = (int16_t)(rng_below(&rng, 1 << 14) - (1 << 13));
+
+    uint64_t start = SDL_GetPerformanceCounter();
+    for (int b = 0; b < BENCH_BUFFERS; b++)
+    {
+        memset(out, 0, sizeof(int16_t) * samples);
+        for (int v = 0; v < BENCH_VOICES; v++)
+        {
+            SDL_MixAudioFormat((uint8_t*)out, (uint8_t const*)(voices + v * samples), AUDIO_S16LSB,
+                sizeof(int16_t) * samples, SDL_MIX_MAXVOLUME / 2);
+        }
+    }
+    double sdlSeconds = seconds_since(start);
+
+    int32_t fadeStep = -MIX_VOLUME_GAIN(SDL_MIX_MAXVOLUME / 2) / BENCH_FRAMES;
+    start = SDL_GetPerformanceCounter();
+    for (int b = 0; b < BENCH_BUFFERS; b++)
+    {
+        memset(acc, 0, sizeof(int32_t) * samples);
+        for (int v = 0; v < BENCH_VOICES; v++)
+        {
+            mix_add(acc, voices + v * samples, BENCH_FRAMES, BENCH_CHANNELS,
+                MIX_VOLUME_GAIN(SDL_MIX_MAXVOLUME / 2), v % 2 ? fadeStep : 0);
+        }
+        mix_store(out, acc, samples);
+    }
+    double mixSeconds = seconds_since(start);
+
+    double frames = (double)BENCH_FRAMES * BENCH_BUFFERS;
+    printf("Mixing %d voices, %d buffers of %d frames\n", BENCH_VOICES, BENCH_BUFFERS, BENCH_FRAMES);
+    printf("SDL_MixAudioFormat: %.3f s (%.1f M frames/s)\n", sdlSeconds, frames / sdlSeconds / 1e6);
+    printf("mix_add/mix_store:  %.3f s (%.1f M frames/s, %.1fx)\n", mixSeconds, frames / mixSeconds / 1e6,
+        sdlSeconds / mixSeconds);
+    free(voices);
+    free(out);
+    free(acc);
+}
+
+// RNG benchmark: draws, cycling through bounds like level generation and
+// bullet spawns use
+#define BENCH_DRAWS 100000000
+
+static void bench_rng(void) {
+    Rng rng;
+    rng_seed(&rng, 1);
+    uint32_t bounds[] = { 2, 20, 100, 640, 480, 1000003 };
+    int numBounds = sizeof(bounds) / sizeof(bounds[0]);
+    // Summed so the draws can't be optimised away
+    uint64_t sum = 0;
+
+    uint64_t start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < BENCH_DRAWS; i++)
+        sum += rng_below(&rng, bounds[i % numBounds]);
+    double seconds = seconds_since(start);
+
+    printf("%d bounded draws in %.3f s (%.1f M draws/s, checksum %llu)\n", BENCH_DRAWS, seconds,
+        BENCH_DRAWS / seconds / 1e6, (unsigned long long)sum);
+}
+
+// Collision benchmark: rects tested against each probe, and probes per round
+#define BENCH_TARGETS 4096
+#define BENCH_PROBES 2000
+#define BENCH_COLLIDE_ROUNDS 5
+
+// Random float in [lo, hi), sometimes snapped to a whole number so rects share
+// edges and speeds as platforms and bullets do
+static float random_float(Rng* rng, float lo, float hi) {
+    float f = lo + (hi - lo) * (rng_next(rng) >> 8) * (1.0f / 16777216);
+    return rng_below(rng, 4) == 0 ? floorf(f) : f;
+}
+
+static MovingRect random_rect(Rng* rng) {
+    MovingRect rect = {
+        .pos = { random_float(rng, 0, 200), random_float(rng, 0, 200) },
+        .dir = { random_float(rng, -1, 1), random_float(rng, -1, 1) },
+        .w = random_float(rng, 1, 50), .h = random_float(rng, 1, 50)
+    };
+    return rect;
+}
+
+// Check every would_collide_many() path gives exactly what would_collide()
+// does for random probes and rects packed close enough to hit often, exiting
+// on any difference, then time each against calling would_collide() per pair
+static void bench_collide(void) {
+    static float xs[BENCH_TARGETS], ys[BENCH_TARGETS], ws[BENCH_TARGETS], hs[BENCH_TARGETS];
+    static float dxs[BENCH_TARGETS], dys[BENCH_TARGETS];
+    static MovingRect targets[BENCH_TARGETS];
+    static Edge expected[BENCH_TARGETS], got[BENCH_TARGETS];
+    static MovingRect probes[BENCH_PROBES];
+    struct { CollidePath path; char const* name; } paths[] = {
+        { COLLIDE_SCALAR, "scalar" }, { COLLIDE_SSE2, "sse2" }, { COLLIDE_AVX2, "avx2" }
+    };
+    int numPaths = sizeof(paths) / sizeof(paths[0]);
+    float const delta = 50;
+    Rng rng;
+    rng_seed(&rng, 1);
+
+    for (int i = 0; i < BENCH_TARGETS; i++)
+    {
+        targets[i] = random_rect(&rng);
+        xs[i] = targets[i].pos.x;
+        ys[i] = targets[i].pos.y;
+        ws[i] = targets[i].w;
+        hs[i] = targets[i].h;
+        dxs[i] = targets[i].dir.x;
+        dys[i] = targets[i].dir.y;
+    }
+    for (int i = 0; i < BENCH_PROBES; i++)
+        probes[i] = random_rect(&rng);
+    // Same rect and a stationary copy, the degenerate cases
+    probes[0] = targets[0];
+    probes[1] = targets[1];
+    probes[1].dir.x = probes[1].dir.y = 0;
+
+    long hits = 0;
+    for (int i = 0; i < BENCH_PROBES; i++)
+    {
+        for (int j = 0; j < BENCH_TARGETS; j++)
+        {
+            expected[j] = would_collide(probes[i], targets[j], delta);
+            hits += expected[j] != EDGE_NONE;
+        }
+        for (int k = 0; k < numPaths; k++)
+        {
+            if (!would_collide_many_path(paths[k].path, &probes[i], xs, ys, ws, hs, dxs, dys,
+                    BENCH_TARGETS, delta, got))
+                continue;
+            for (int j = 0; j < BENCH_TARGETS; j++)
+            {
+                if (got[j] != expected[j])
+                {
+                    fprintf(stderr, "%s path gave edge %d instead of %d for probe %d and rect %d\n",
+                        paths[k].name, got[j], expected[j], i, j);
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+    }
+    long pairs = (long)BENCH_PROBES * BENCH_TARGETS;
+    printf("All paths match would_collide on %ld pairs (%.1f%% colliding)\n", pairs, 100.0 * hits / pairs);
+
+    // Summed so the calls can't be optimised away
+    long sum = 0;
+    uint64_t start = SDL_GetPerformanceCounter();
+    for (int round = 0; round < BENCH_COLLIDE_ROUNDS; round++)
+        for (int i = 0; i < BENCH_PROBES; i++)
+            for (int j = 0; j < BENCH_TARGETS; j++)
+                sum += would_collide(probes[i], targets[j], delta);
+    double reference = seconds_since(start);
+    printf("would_collide loop: %.1f M pairs/s\n", pairs * BENCH_COLLIDE_ROUNDS / reference / 1e6);
+
+    for (int k = 0; k < numPaths; k++)
+    {
+        if (!would_collide_many_path(paths[k].path, &probes[0], xs, ys, ws, hs, dxs, dys, 1, delta, got))
+        {
+            printf("%s: not supported by this CPU\n", paths[k].name);
+            continue;
+        }
+        start = SDL_GetPerformanceCounter();
+        for (int round = 0; round < BENCH_COLLIDE_ROUNDS; round++)
+        {
+            for (int i = 0; i < BENCH_PROBES; i++)
+            {
+                would_collide_many_path(paths[k].path, &probes[i], xs, ys, ws, hs, dxs, dys,
+                    BENCH_TARGETS, delta, got);
+                sum += got[i % BENCH_TARGETS];
+            }
+        }
+        double seconds = seconds_since(start);
+        printf("%s: %.1f M pairs/s (%.2fx)\n", paths[k].name,
+            pairs * BENCH_COLLIDE_ROUNDS / seconds / 1e6, reference / seconds);
+    }
+    printf("checksum %ld\n", sum);
+}
+
+// Jump check: longest a jump may take in ms
+#define JUMP_MAX_MS 10000
+
+// Run one jump from a wide floor at the given tick rate, giving its height and
+// the time from leaving the floor to landing again. Returns false if it never
+// landed.
+static bool measure_jump(GameWorld* world, unsigned int tickRate, float* apex, double* airMs) {
+    float stepMs = 1000.0f / tickRate;
+    world_default_params(&world->params);
+    // No bullets, coins or lava, just one platform
+    world->params.minBulletDelay = world->params.maxBulletDelay = JUMP_MAX_MS * 10;
+    world->endless = false;
+    world->seed = 0;
+    world_setup(world);
+    MovingRect floor = { .pos = { -10000, 0 }, .dir = { 0, 0 }, .w = 20000, .h = platformHeight };
+    world->platforms[0] = floor;
+    world->numPlatforms = 1;
+    world->numCoins = 0;
+    world->lava.pos.y = 1e6;
+    if (!grid_build(&world->platformGrid, world->platforms, 1, floor.w, floor.h)
+            || !grid_build(&world->coinGrid, world->coins, 0, floor.w, floor.h))
+    {
+        fprintf(stderr, "Error allocating grid\n");
+        exit(EXIT_FAILURE);
+    }
+    world->player.pos.x = 0;
+    world->player.pos.y = -PLAYER_SIZE - 1;
+    world->player.dir.x = world->player.dir.y = 0;
+
+    // Settle onto the floor
+    Keys keys = { false, false, false, false };
+    for (unsigned int i = 0; i < tickRate; i++)
+        world_step(world, &keys, stepMs);
+    float floorY = world->player.pos.y;
+
+    keys.u = true;
+    world_step(world, &keys, stepMs);
+    keys.u = false;
+    double jumpTime = world->time;
+    *apex = 0;
+    while (world->time - jumpTime < JUMP_MAX_MS)
+    {
+        world_step(world, &keys, stepMs);
+        if (floorY - world->player.pos.y > *apex)
+            *apex = floorY - world->player.pos.y;
+        if (world->player.pos.y >= floorY)
+        {
+            *airMs = world->time - jumpTime;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Check a jump is the same height and length at several tick rates, to within
+// how far the player moves in one step, exiting if not
+static void bench_jump(void) {
+    unsigned int tickRates[] = { 60, 120, 240 };
+    int numRates = sizeof(tickRates) / sizeof(tickRates[0]);
+    GameWorld* world = world_create();
+    if (!world)
+    {
+        fprintf(stderr, "Error allocating world\n");
+        exit(EXIT_FAILURE);
+    }
+    // The jump with continuous physics
+    float expectedApex = playerJumpSpeed * playerJumpSpeed / (2 * gravity);
+    double expectedAirMs = 2 * playerJumpSpeed / gravity;
+    printf("Expected: %.1f px high, %.0f ms in the air\n", expectedApex, expectedAirMs);
+
+    bool ok = true;
+    for (int i = 0; i < numRates; i++)
+    {
+        float apex;
+        double airMs;
+        float stepMs = 1000.0f / tickRates[i];
+        if (!measure_jump(world, tickRates[i], &apex, &airMs))
+        {
+            printf("%u Hz: never landed\n", tickRates[i]);
+            ok = false;
+            continue;
+        }
+        bool match = fabsf(apex - expectedApex) <= playerJumpSpeed * stepMs
+            && fabs(airMs - expectedAirMs) <= stepMs;
+        printf("%u Hz: %.1f px high, %.0f ms in the air%s\n", tickRates[i], apex, airMs,
+            match ? "" : " (off by more than a step)");
+        ok = ok && match;
+    }
+    world_destroy(world);
+    if (!ok)
+        exit(EXIT_FAILURE);
+}
+
+// Setup benchmark: levels to generate
+#define BENCH_SETUPS 200
+
+// Generate the fixed level over and over, as starting every game does
+static void bench_setup(void) {
+    GameWorld* world = world_create();
+    if (!world)
+    {
+        fprintf(stderr, "Error allocating world\n");
+        exit(EXIT_FAILURE);
+    }
+    double worst = 0;
+    uint64_t start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < BENCH_SETUPS; i++)
+    {
+        uint64_t setupStart = SDL_GetPerformanceCounter();
+        world->seed = i;
+        world_setup(world);
+        double seconds = seconds_since(setupStart);
+        if (seconds > worst)
+            worst = seconds;
+    }
+    double seconds = seconds_since(start);
+
+    printf("Generated %d levels of %d platforms and %d coins\n", BENCH_SETUPS, NUM_PLATFORMS, NUM_COINS);
+    printf("%.3f ms average and %.3f ms worst per level\n", seconds / BENCH_SETUPS * 1000, worst * 1000);
+    world_destroy(world);
+}
+
+#define BENCH_STEPS 5000000
+// Ticks the random actions in the step benchmark are held for
+#define BENCH_HOLD_TICKS 20
+
+// Step libevader with random actions and observe after every step, as a bot
+// being trained would, starting a new game whenever one ends
+static void bench_step(void) {
+    Evader* evader = evader_create();
+    if (!evader)
+    {
+        fprintf(stderr, "Error allocating world\n");
+        exit(EXIT_FAILURE);
+    }
+    static float observation[EVADER_OBS_SIZE];
+    Rng rng;
+    rng_seed(&rng, 0);
+    uint64_t seed = 0;
+    evader_reset(evader, seed);
+    unsigned int actions = 0;
+    unsigned long games = 1;
+    float checksum = 0;
+
+    uint64_t start = SDL_GetPerformanceCounter();
+    for (long i = 0; i < BENCH_STEPS; i++)
+    {
+        if (i % BENCH_HOLD_TICKS == 0)
+            actions = rng_next(&rng) & (EVADER_LEFT | EVADER_RIGHT | EVADER_UP);
+        if (evader_step(evader, actions) != EVADER_PLAYING)
+        {
+            evader_reset(evader, ++seed);
+            games++;
+        }
+        evader_observe(evader, observation);
+        checksum += observation[EVADER_OBS_PLAYER_SIZE + 1];
+    }
+    double seconds = seconds_since(start);
+
+    printf("%d steps and observations of %d floats over %lu games (checksum %g)\n",
+        BENCH_STEPS, EVADER_OBS_SIZE, games, checksum);
+    printf("%.2f million steps per second\n", BENCH_STEPS / seconds / 1e6);
+    evader_destroy(evader);
+}
+
+// Audio render: seconds of audio to render, and what to play when
+#define RENDER_SECONDS 10
+
+typedef enum ScriptAction {
+    SCRIPT_SOUND,
+    SCRIPT_MUSIC,
+    SCRIPT_CROSSFADE,
+    SCRIPT_STOP_MUSIC
+} ScriptAction;
+
+typedef struct ScriptEvent {
+    // Time from the start of the render, rounded up to the next audio buffer
+    unsigned int ms;
+    ScriptAction action;
+    char const* path;
+    int volume;
+    // Times to do it at once
+    int count;
+} ScriptEvent;
+
+// Music streaming and crossfading with sounds on top, including a burst of
+// more coins than there are voices
+static ScriptEvent const audioScript[] = {
+    { 0, SCRIPT_MUSIC, "assets/sound/win.wav", 64, 1 },
+    { 500, SCRIPT_SOUND, "assets/sound/coin.wav", 100, 1 },
+    { 1000, SCRIPT_SOUND, "assets/sound/coin.wav", 100, 1 },
+    { 1200, SCRIPT_SOUND, "assets/sound/coin.wav", 60, 1 },
+    { 2000, SCRIPT_CROSSFADE, "assets/sound/death.wav", 64, 1 },
+    { 3000, SCRIPT_SOUND, "assets/sound/coin.wav", 20, 30 },
+    { 5000, SCRIPT_MUSIC, "assets/sound/win.wav", 100, 1 },
+    { 7000, SCRIPT_SOUND, "assets/sound/death.wav", 128, 1 },
+    { 8000, SCRIPT_STOP_MUSIC, NULL, 0, 1 },
+};
+
+static void run_script_event(ScriptEvent const* event) {
+    switch (event->action)
+    {
+        case SCRIPT_SOUND:
+            playSound(event->path, event->volume);
+            break;
+        case SCRIPT_MUSIC:
+            playMusic(event->path, event->volume);
+            break;
+        case SCRIPT_CROSSFADE:
+            crossfadeMusicStream(event->path, event->volume, 1000);
+            break;
+        case SCRIPT_STOP_MUSIC:
+            crossfadeMusicFromMemory(NULL, 0, 1000);
+            break;
+    }
+}
+
+static void write_le(FILE* file, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        fputc((value >> (8 * i)) & 0xff, file);
+}
+
+// 16 bit PCM WAVE header for dataBytes bytes of samples
+static void write_wav_header(FILE* file, int freq, int channels, uint32_t dataBytes) {
+    fwrite("RIFF", 1, 4, file);
+    write_le(file, 36 + dataBytes, 4);
+    fwrite("WAVEfmt ", 1, 8, file);
+    write_le(file, 16, 4);
+    write_le(file, 1, 2);
+    write_le(file, channels, 2);
+    write_le(file, freq, 4);
+    write_le(file, freq * channels * sizeof(int16_t), 4);
+    write_le(file, channels * sizeof(int16_t), 2);
+    write_le(file, 16, 2);
+    fwrite("data", 1, 4, file);
+    write_le(file, dataBytes, 4);
+}
+
+bool bench_render_audio(char const* path) {
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Error opening %s\n", path);
+        return false;
+    }
+    initAudioOffline();
+    AudioStats stats;
+    getAudioStats(&stats);
+    int frameBytes = stats.channels * sizeof(int16_t);
+    int length = stats.samples * frameBytes;
+    uint8_t* buffer = malloc(length);
+    if (!buffer)
+    {
+        fprintf(stderr, "Error allocating audio render buffer\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Filled in once the length is known
+    write_wav_header(file, stats.frequency, stats.channels, 0);
+    uint64_t frames = 0;
+    uint64_t totalFrames = (uint64_t)RENDER_SECONDS * stats.frequency;
+    size_t nextEvent = 0;
+    double seconds = 0;
+    while (frames < totalFrames)
+    {
+        while (nextEvent < sizeof(audioScript) / sizeof(audioScript[0])
+                && audioScript[nextEvent].ms * (uint64_t)stats.frequency <= frames * 1000)
+        {
+            for (int i = 0; i < audioScript[nextEvent].count; i++)
+                run_script_event(&audioScript[nextEvent]);
+            nextEvent++;
+        }
+        uint64_t start = SDL_GetPerformanceCounter();
+        renderAudio(buffer, length);
+        seconds += seconds_since(start);
+        fwrite(buffer, 1, length, file);
+        frames += stats.samples;
+    }
+    getAudioStats(&stats);
+    endAudio();
+    free(buffer);
+
+    fseek(file, 0, SEEK_SET);
+    write_wav_header(file, stats.frequency, stats.channels, frames * frameBytes);
+    bool ok = !ferror(file);
+    ok = fclose(file) == 0 && ok;
+    if (!ok)
+    {
+        fprintf(stderr, "Error writing %s\n", path);
+        return false;
+    }
+
+    printf("Rendered %.1f s of audio to %s in %u callbacks of %u frames\n",
+        (double)frames / stats.frequency, path, stats.callbacks, stats.samples);
+    printf("%.1f M frames/s (%.0fx real time), %u us average and %u us worst callback (%u us deadline), %u music underruns\n",
+        frames / seconds / 1e6, frames / seconds / stats.frequency, stats.averageUs, stats.worstUs,
+        stats.deadlineUs, stats.underruns);
+    return true;
+}
+
+bool bench_run(char const* name) {
+    if (strcmp(name, "mixer") == 0)
+        bench_mixer();
+    else if (strcmp(name, "rng") == 0)
+        bench_rng();
+    else if (strcmp(name, "collide") == 0)
+        bench_collide();
+    else if (strcmp(name, "jump") == 0)
+        bench_jump();
+    else if (strcmp(name, "setup") == 0)
+        bench_setup();
+    else if (strcmp(name, "step") == 0)
+        bench_step();
+    else
+        return false;
+    return true;
+}
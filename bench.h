@@ -0,0 +1,16 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+
+// Run the named microbenchmark and print its results. Returns false if there
+// is no benchmark with that name.
+bool bench_run(char const* name);
+
+// Mix a scripted sequence of sounds and music with no audio device, writing
+// it to a WAVE file at path and printing how fast it mixed. The file is the
+// same every run for the same audio buffer size. Returns false if the file
+// couldn't be written.
+bool bench_render_audio(char const* path);
+
+#endif
@@ -0,0 +1,244 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "bot.h"
+#include "world.h"
+#include "constants.h"
+#include "rng.h"
+#include "grid.h"
+
+// Ticks the random policy holds the same keys for
+#define RANDOM_HOLD_TICKS 20
+// How far ahead in ms the bot looks for bullets about to hit it
+#define DODGE_TIME 400
+// Most platforms to look through for the one the player stands on
+#define STANDING_QUERY 16
+// How far around the player to look for platforms to land on, and the most
+// to look through before checking them all
+#define LANDING_REACH 1000
+#define LANDING_QUERY 64
+
+void bot_init(Bot* bot, BotPolicy policy, uint64_t seed) {
+    memset(bot, 0, sizeof(*bot));
+    bot->policy = policy;
+    rng_seed(&bot->rng, seed);
+}
+
+static void random_keys(Bot* bot) {
+    if (bot->ticks % RANDOM_HOLD_TICKS == 0)
+    {
+        uint32_t bits = rng_next(&bot->rng);
+        bot->keys.l = bits & 1;
+        bot->keys.r = !bot->keys.l && (bits & 2);
+        bot->keys.u = bits & 4;
+        bot->keys.d = false;
+    }
+}
+
+// Platform the player is standing on, NULL if it is in the air
+static MovingRect const* standing_on(GameWorld const* world) {
+    MovingRect const* player = &world->player;
+    if (player->dir.y != 0)
+        return NULL;
+    float feet = player->pos.y + player->h;
+    int found[STANDING_QUERY];
+    int n = grid_query(&world->platformGrid, player->pos.x, feet, player->pos.x + player->w, feet + 1,
+        found, STANDING_QUERY);
+    int numCandidates = n < 0 ? world->numPlatforms : n;
+    for (int k = 0; k < numCandidates; k++)
+    {
+        MovingRect const* platform = &world->platforms[n < 0 ? k : found[k]];
+        if (fabsf(platform->pos.y - feet) < 1 && player->pos.x < platform->pos.x + platform->w
+                && platform->pos.x < player->pos.x + player->w)
+            return platform;
+    }
+    return NULL;
+}
+
+// The platform other than skip (which may be NULL) that a player at x with its
+// feet at feet, moving up or down at speed vy, could land on that is nearest
+// the target. NULL if there is none (the player would fall into the lava).
+static MovingRect const* choose_landing(GameWorld const* world, float x, float feet, float vy,
+        float targetX, float targetY, MovingRect const* skip) {
+    float w = world->player.w;
+    float gravity = world->params.gravity;
+    int found[LANDING_QUERY];
+    int n = grid_query(&world->platformGrid, x - LANDING_REACH, feet - LANDING_REACH,
+        x + w + LANDING_REACH, feet + LANDING_REACH, found, LANDING_QUERY);
+    int numCandidates = n < 0 ? world->numPlatforms : n;
+    MovingRect const* best = NULL;
+    float bestScore = 0;
+    for (int k = 0; k < numCandidates; k++)
+    {
+        MovingRect const* platform = &world->platforms[n < 0 ? k : found[k]];
+        float drop = platform->pos.y - feet;
+        // Platforms above are only reachable if the player is rising fast
+        // enough to get over them
+        float disc = vy * vy + 2 * gravity * drop;
+        if (platform == skip || disc < 0 || (drop <= 0 && vy >= 0))
+            continue;
+        // Time until the player comes down to the platform, and how far
+        // sideways it can get meanwhile
+        float t = (-vy + sqrtf(disc)) / gravity;
+        float reach = playerHorizontalSpeed * t;
+        if (platform->pos.x > x + w + reach || platform->pos.x + platform->w < x - reach)
+            continue;
+        float gapX = fmaxf(0, fmaxf(platform->pos.x - targetX, targetX - (platform->pos.x + platform->w)));
+        float score = gapX + fabsf(platform->pos.y - targetY);
+        if (!best || score < bestScore)
+        {
+            best = platform;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+// Head for the nearest coin a jump could reach, walking off the end of the
+// platform when the coin is somewhere below it
+static void seek_coin(Bot* bot, GameWorld const* world) {
+    MovingRect const* player = &world->player;
+    float px = player->pos.x + player->w / 2, py = player->pos.y + player->h / 2;
+    WorldParams const* params = &world->params;
+    float jumpHeight = params->playerJumpSpeed * params->playerJumpSpeed / (2 * params->gravity);
+    MovingRect const* nearest = NULL;
+    float nearestDist = 0;
+    bool nearestReachable = false;
+    for (int i = 0; i < world->numCoins; i++)
+    {
+        if (world->coinsCollected[i])
+            continue;
+        MovingRect const* coin = &world->coins[i];
+        float dx = coin->pos.x + coin->w / 2 - px, dy = coin->pos.y + coin->h / 2 - py;
+        float dist = dx * dx + dy * dy;
+        // Coins higher than a jump only count if nothing else is left
+        bool reachable = player->pos.y + player->h - (coin->pos.y + coin->h) < jumpHeight;
+        if (!nearest || (reachable && !nearestReachable)
+                || (reachable == nearestReachable && dist < nearestDist))
+        {
+            nearest = coin;
+            nearestDist = dist;
+            nearestReachable = reachable;
+        }
+    }
+    memset(&bot->keys, false, sizeof(bot->keys));
+    if (!nearest)
+        return;
+    float dx = nearest->pos.x + nearest->w / 2 - px;
+    bot->keys.l = dx < -coinSize / 2;
+    bot->keys.r = dx > coinSize / 2;
+    bot->keys.u = nearest->pos.y + nearest->h < player->pos.y;
+
+    MovingRect const* platform = standing_on(world);
+    float coinX = nearest->pos.x + nearest->w / 2;
+    float coinBottom = nearest->pos.y + nearest->h;
+    if (!platform)
+    {
+        // Steer for the landing nearest the coin, and the coin once over it
+        MovingRect const* landing = choose_landing(world, player->pos.x, player->pos.y + player->h,
+            player->dir.y, coinX, coinBottom, NULL);
+        if (landing)
+        {
+            float left = landing->pos.x, right = landing->pos.x + landing->w - player->w;
+            float targetX = fminf(fmaxf(coinX - player->w / 2, left), right);
+            bot->keys.l = targetX < player->pos.x - 1;
+            bot->keys.r = targetX > player->pos.x + 1;
+        }
+        return;
+    }
+
+    float left = platform->pos.x, right = platform->pos.x + platform->w;
+    if (nearest->pos.y > platform->pos.y && coinX > left - player->w - coinSize
+            && coinX < right + player->w + coinSize)
+    {
+        // The platform is in the way, go off whichever end is nearer the coin
+        bot->keys.l = coinX - left < right - coinX;
+        bot->keys.r = !bot->keys.l;
+    }
+    // Never step off an end with nothing below to land on. Jump across to
+    // another platform instead if there is one, otherwise stop.
+    float jumpSpeed = params->playerJumpSpeed;
+    float edge = bot->keys.l ? left - player->w : right;
+    float lookAhead = playerHorizontalSpeed * DODGE_TIME;
+    bool nearEdge = bot->keys.l ? player->pos.x - lookAhead < edge : player->pos.x + lookAhead > edge;
+    if ((bot->keys.l || bot->keys.r) && nearEdge
+            && !choose_landing(world, edge, platform->pos.y, 0, coinX, coinBottom, platform))
+    {
+        if (choose_landing(world, player->pos.x, platform->pos.y, -jumpSpeed, coinX, coinBottom, platform))
+            bot->keys.u = true;
+        else
+            bot->keys.l = bot->keys.r = false;
+    }
+}
+
+// Get out of the way of the bullet that will pass closest soonest, returns
+// false if none is close. Only done from a platform, since in the air the keys
+// are better spent steering towards the coin.
+static bool dodge_bullets(Bot* bot, GameWorld const* world) {
+    MovingRect const* player = &world->player;
+    if (!standing_on(world))
+        return false;
+    float px = player->pos.x + player->w / 2, py = player->pos.y + player->h / 2;
+    float reach = (PLAYER_SIZE + BULLET_SIZE) * 1.5f;
+    for (unsigned int i = 0; i < world->numBulletsSpawned; i++)
+    {
+        MovingRect const* bullet = &world->bullets[i].movingRect;
+        float dx = px - (bullet->pos.x + bullet->w / 2), dy = py - (bullet->pos.y + bullet->h / 2);
+        float speed2 = bullet->dir.x * bullet->dir.x + bullet->dir.y * bullet->dir.y;
+        if (speed2 == 0)
+            continue;
+        // When the bullet is closest and how far off it is then
+        float t = (dx * bullet->dir.x + dy * bullet->dir.y) / speed2;
+        if (t < 0 || t > DODGE_TIME)
+            continue;
+        float missX = dx - bullet->dir.x * t, missY = dy - bullet->dir.y * t;
+        if (missX * missX + missY * missY > reach * reach)
+            continue;
+        memset(&bot->keys, false, sizeof(bot->keys));
+        if (fabsf(bullet->dir.x) > fabsf(bullet->dir.y))
+        {
+            // Jump over bullets coming from the side
+            bot->keys.u = true;
+        }
+        else
+        {
+            // Step out of the way of bullets from above or below
+            bot->keys.l = missX < 0;
+            bot->keys.r = !bot->keys.l;
+        }
+        return true;
+    }
+    return false;
+}
+
+void bot_keys(Bot* bot, GameWorld const* world, Keys* keys) {
+    switch (bot->policy)
+    {
+    case POLICY_IDLE:
+        memset(&bot->keys, false, sizeof(bot->keys));
+        break;
+    case POLICY_RANDOM:
+        random_keys(bot);
+        break;
+    case POLICY_SEEKER:
+        if (!dodge_bullets(bot, world))
+            seek_coin(bot, world);
+        break;
+    }
+    bot->ticks++;
+    *keys = bot->keys;
+}
+
+bool bot_policy_from_name(char const* name, BotPolicy* policy) {
+    if (strcmp(name, "idle") == 0)
+        *policy = POLICY_IDLE;
+    else if (strcmp(name, "random") == 0)
+        *policy = POLICY_RANDOM;
+    else if (strcmp(name, "bot") == 0)
+        *policy = POLICY_SEEKER;
+    else
+        return false;
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef BOT_H
+#define BOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "world.h"
+#include "rng.h"
+
+// Ways of choosing keys for games nobody is playing
+typedef enum BotPolicy {
+    // Hold nothing
+    POLICY_IDLE,
+    // Hold random keys, changing every so often
+    POLICY_RANDOM,
+    // Head for the nearest coin, jumping when it is above, dropping off the
+    // platform when it is below and steering in the air for the landing
+    // nearest it. Dodge bullets about to hit while on a platform.
+    POLICY_SEEKER
+} BotPolicy;
+
+typedef struct Bot {
+    BotPolicy policy;
+    Rng rng;
+    Keys keys;
+    unsigned long ticks;
+} Bot;
+
+// Start a bot for a new game. The same seed and world always get the same keys.
+void bot_init(Bot* bot, BotPolicy policy, uint64_t seed);
+
+// Choose the keys to hold for the next tick
+void bot_keys(Bot* bot, GameWorld const* world, Keys* keys);
+
+// Policy from its name ("idle", "random" or "bot"), returns false if unknown
+bool bot_policy_from_name(char const* name, BotPolicy* policy);
+
+#endif
@@ -0,0 +1,87 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "chunk.h"
+#include "world.h"
+#include "constants.h"
+#include "rng.h"
+
+// Slot in the platform/coin arrays holding the given chunk
+static int chunk_slot(int chunk) {
+    int slot = chunk % NUM_CHUNK_SLOTS;
+    return slot < 0 ? slot + NUM_CHUNK_SLOTS : slot;
+}
+
+// Chunk containing the given x coordinate
+static int chunk_at(float x) {
+    return (int)floorf(x / (CHUNK_COLS * (platformSeparation + platformWidth)));
+}
+
+static void generate_chunk(GameWorld* world, int chunk) {
+    Rng rng;
+    rng_seed(&rng, rng_hash(world->seed, (uint64_t)(int64_t)chunk));
+    int first = chunk_slot(chunk) * CHUNK_PLATFORMS;
+
+    for (int i = 0; i < CHUNK_PLATFORMS; i++)
+    {
+        MovingRect* platform = &world->platforms[first + i];
+        // No movement for platforms
+        platform->dir.x = 0;
+        platform->dir.y = 0;
+
+        // Positioning, same layout as the fixed level
+        int col = chunk * CHUNK_COLS + i % CHUNK_COLS;
+        int row = i / CHUNK_COLS;
+        platform->pos.x = col * (platformSeparation + platformWidth) + (int)rng_below(&rng, platformSeparation);
+        platform->pos.y = row * (platformSeparation + platformHeight) + (int)rng_below(&rng, platformSeparation);
+        platform->w = platformWidth;
+        platform->h = platformHeight;
+
+        // Same chance of a coin as in the fixed level. Every platform gets a
+        // coin slot, empty ones are marked as already collected.
+        MovingRect* coin = &world->coins[first + i];
+        coin->dir.x = 0;
+        coin->dir.y = 0;
+        coin->pos = platform->pos;
+        coin->pos.y -= platformHeight + 1;
+        coin->pos.x += (platformWidth - coinSize) / 2;
+        coin->w = coinSize;
+        coin->h = coinSize;
+        world->coinsCollected[first + i] = rng_below(&rng, NUM_PLATFORMS) >= NUM_COINS;
+    }
+}
+
+void chunks_setup(GameWorld* world) {
+    world->numPlatforms = ENDLESS_PLATFORMS;
+    world->numCoins = ENDLESS_PLATFORMS;
+    // Player starts in chunk 0
+    world->firstChunk = -1;
+    for (int chunk = world->firstChunk; chunk < world->firstChunk + NUM_CHUNK_SLOTS; chunk++)
+        generate_chunk(world, chunk);
+}
+
+bool chunks_update(GameWorld* world) {
+    // Keep the player in one of the middle chunks, with at least one loaded
+    // chunk either side. Only move the window once the player leaves the
+    // middle so walking back and forth over a boundary doesn't regenerate.
+    int playerChunk = chunk_at(world->player.pos.x);
+    int firstChunk = world->firstChunk;
+    if (playerChunk < firstChunk + 1)
+        firstChunk = playerChunk - 1;
+    else if (playerChunk > firstChunk + NUM_CHUNK_SLOTS - 2)
+        firstChunk = playerChunk - NUM_CHUNK_SLOTS + 2;
+    if (firstChunk == world->firstChunk)
+        return false;
+
+    // Generate the chunks that weren't loaded before, into the slots of the
+    // ones that fell out of range
+    int oldFirst = world->firstChunk;
+    world->firstChunk = firstChunk;
+    for (int chunk = firstChunk; chunk < firstChunk + NUM_CHUNK_SLOTS; chunk++)
+    {
+        if (chunk < oldFirst || chunk >= oldFirst + NUM_CHUNK_SLOTS)
+            generate_chunk(world, chunk);
+    }
+    return true;
+}
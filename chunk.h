@@ -0,0 +1,26 @@
+#ifndef CHUNK_H
+#define CHUNK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "world.h"
+
+/*
+ * Endless mode.
+ * The level goes on forever to the left and right. It is split into chunks of
+ * CHUNK_COLS platform columns, each generated from the world seed and its
+ * chunk index, so a chunk always comes out the same. NUM_CHUNK_SLOTS chunks
+ * around the player are kept in the world's platform and coin arrays; chunks
+ * are generated as the player approaches and overwritten once far away.
+ * Coins in a chunk that is dropped and later regenerated come back.
+ */
+
+// Generate the chunks around the start position
+void chunks_setup(GameWorld* world);
+
+// Load chunks the player is approaching, replacing ones far behind.
+// Returns true if any chunk was replaced.
+bool chunks_update(GameWorld* world);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef COMMON_H
+#define COMMON_H
+
+#include <stdint.h>
+
+// Types and constants shared by the simulation and the SDL front end. Nothing
+// here needs SDL, so the simulation (and libevader) builds without it.
+
+typedef struct Colour {
+    uint8_t r, g, b;
+} Colour;
+
+typedef uint64_t Time;
+
+extern int const WINDOW_WIDTH;
+extern int const WINDOW_HEIGHT;
+
+// How long to delay before updating in ms
+extern uint32_t const DELAY;
+
+#endif
@@ -1,12 +1,15 @@
 #include <stdint.h>
 
-#include <SDL2/SDL.h>
-
 #include "rect.h"
-#include "mysdl.h"
+#include "common.h"
 #include "constants.h"
 
-unsigned int const soundVolume = SDL_MIX_MAXVOLUME * 2 / 3;
+int const WINDOW_WIDTH = 800;
+int const WINDOW_HEIGHT = 600;
+uint32_t const DELAY = 10;
+
+unsigned int const musicFadeTime = 1000;
+unsigned int const lowLatencyAudioBuffer = 512;
 
 int const PLAYER_SIZE = 10;
 // player horizontal movement in pixels per ms
@@ -31,7 +34,14 @@ int const platformSeparation = 200;
 
 int const coinDisplayWidth = 10;
 
-float const gravity = 0.01;
+unsigned int const defaultTickRate = 120;
+int const defaultMaxStepsPerFrame = 8;
+unsigned int const defaultFps = 100;
+int const idleWait = 500;
+unsigned int const batchGameTime = 600;
+
+// 0.01 px/ms every 10 ms frame, as the game had before its fixed timestep
+float const gravity = 0.001;
 float const terminalVelocity = 3;
 
 // Min time to wait before spawning bullet in ms
@@ -4,7 +4,7 @@
 #include <stdint.h>
 
 #include "rect.h"
-#include "mysdl.h"
+#include "common.h"
 
 typedef struct Bullet {
     MovingRect movingRect;
@@ -16,7 +16,10 @@ typedef enum GameState {
 
 #define ENABLE_LOG 0
 
-extern unsigned int const soundVolume;
+// Time for one music to crossfade into another in ms
+extern unsigned int const musicFadeTime;
+// Frames per audio buffer with --low-latency
+extern unsigned int const lowLatencyAudioBuffer;
 
 extern int const PLAYER_SIZE;
 // player horizontal movement in pixels per ms
@@ -38,17 +41,47 @@ extern Colour coinColour;
 extern Colour greyCoinColour;
 extern Colour faceColour;
 
-// Number of platforms per row/column
+// Number of platforms per row/column. This and COIN_DISPLAY_GRID_SIZE can be
+// set when building (e.g. CPPFLAGS=-DPLATFORM_GRID_SIZE=1000) for huge levels.
+#ifndef PLATFORM_GRID_SIZE
 #define PLATFORM_GRID_SIZE 10
+#endif
 #define NUM_PLATFORMS (PLATFORM_GRID_SIZE * PLATFORM_GRID_SIZE)
 extern int const platformHeight;
 extern int const platformWidth;
 extern int const platformSeparation;
 
+// Endless mode: the level is made of chunks of CHUNK_COLS platform columns
+// (and PLATFORM_GRID_SIZE rows), of which NUM_CHUNK_SLOTS are loaded at once
+#define CHUNK_COLS 8
+#define CHUNK_PLATFORMS (CHUNK_COLS * PLATFORM_GRID_SIZE)
+#define NUM_CHUNK_SLOTS 4
+#define ENDLESS_PLATFORMS (NUM_CHUNK_SLOTS * CHUNK_PLATFORMS)
+// Room for the platforms of either mode
+#define MAX_PLATFORMS (NUM_PLATFORMS > ENDLESS_PLATFORMS ? NUM_PLATFORMS : ENDLESS_PLATFORMS)
+
+#ifndef COIN_DISPLAY_GRID_SIZE
 #define COIN_DISPLAY_GRID_SIZE 5
+#endif
 extern int const coinDisplayWidth;
 #define NUM_COINS (COIN_DISPLAY_GRID_SIZE * COIN_DISPLAY_GRID_SIZE)
+// Endless mode has a coin slot above every loaded platform
+#define MAX_COINS (NUM_COINS > ENDLESS_PLATFORMS ? NUM_COINS : ENDLESS_PLATFORMS)
+
+// Default number of simulation steps per second
+extern unsigned int const defaultTickRate;
+// Max simulation steps to catch up on in one frame after a slow frame
+extern int const defaultMaxStepsPerFrame;
+// Default number of frames drawn per second
+extern unsigned int const defaultFps;
+// Longest to sleep waiting for an event while paused or on the game over
+// screen, in ms
+extern int const idleWait;
+// Longest a game in a batch (--batch) runs by default, in seconds of game time
+extern unsigned int const batchGameTime;
 
+// Downward acceleration of the player in pixels per ms per ms, so jumps are
+// the same height at any tick rate
 extern float const gravity;
 extern float const terminalVelocity;
 
@@ -0,0 +1,181 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "evader.h"
+#include "world.h"
+#include "constants.h"
+#include "rect.h"
+#include "grid.h"
+
+// Most grid query results to look through before falling back to a full scan
+#define MAX_OBSERVED 256
+// Room for the longest list of nearest things in an observation
+#define MAX_NEAREST 8
+#if EVADER_OBS_BULLETS > MAX_NEAREST || EVADER_OBS_PLATFORMS > MAX_NEAREST || EVADER_OBS_COINS > MAX_NEAREST
+#error "MAX_NEAREST is too small for the observation"
+#endif
+
+struct Evader {
+    GameWorld* world;
+    float stepMs;
+};
+
+// The k nearest things seen so far, nearest first
+typedef struct Nearest {
+    float dist[MAX_NEAREST];
+    int items[MAX_NEAREST];
+    int n, k;
+} Nearest;
+
+Evader* evader_create(void) {
+    Evader* evader = malloc(sizeof(*evader));
+    if (!evader)
+        return NULL;
+    evader->world = world_create();
+    if (!evader->world)
+    {
+        free(evader);
+        return NULL;
+    }
+    evader->stepMs = 1000.0f / defaultTickRate;
+    return evader;
+}
+
+void evader_destroy(Evader* evader) {
+    if (!evader)
+        return;
+    world_destroy(evader->world);
+    free(evader);
+}
+
+void evader_reset(Evader* evader, uint64_t seed) {
+    evader->world->endless = false;
+    evader->world->seed = seed;
+    world_setup(evader->world);
+}
+
+EvaderStatus evader_step(Evader* evader, unsigned int actions) {
+    GameWorld* world = evader->world;
+    if (world->state == STATE_CONTINUE)
+    {
+        Keys keys = {
+            .l = actions & EVADER_LEFT, .r = actions & EVADER_RIGHT,
+            .u = actions & EVADER_UP, .d = actions & EVADER_DOWN
+        };
+        world_step(world, &keys, evader->stepMs);
+    }
+    else
+        world->events.coinsCollected = 0;
+
+    if (world->state == STATE_GAME_OVER_WON)
+        return EVADER_WON;
+    if (world->state == STATE_GAME_OVER_LOST)
+        return EVADER_LOST;
+    return EVADER_PLAYING;
+}
+
+int evader_coins_collected(Evader const* evader) {
+    return evader->world->events.coinsCollected;
+}
+
+// Squared distance between the centres of two rectangles
+static inline float centre_dist(MovingRect const* a, MovingRect const* b) {
+    float dx = (b->pos.x + b->w / 2) - (a->pos.x + a->w / 2);
+    float dy = (b->pos.y + b->h / 2) - (a->pos.y + a->h / 2);
+    return dx * dx + dy * dy;
+}
+
+static inline void nearest_add(Nearest* nearest, float dist, int item) {
+    if (nearest->n == nearest->k && dist >= nearest->dist[nearest->k - 1])
+        return;
+    int i = nearest->n < nearest->k ? nearest->n++ : nearest->k - 1;
+    for (; i > 0 && nearest->dist[i - 1] > dist; i--)
+    {
+        nearest->dist[i] = nearest->dist[i - 1];
+        nearest->items[i] = nearest->items[i - 1];
+    }
+    nearest->dist[i] = dist;
+    nearest->items[i] = item;
+}
+
+// Find the k nearest of rects to the player within a window around it,
+// skipping any marked in skip (which may be NULL)
+static void find_nearest(Nearest* nearest, int k, GameWorld const* world, SpatialGrid const* grid,
+        MovingRect const* rects, int numRects, bool const* skip) {
+    MovingRect const* player = &world->player;
+    nearest->n = 0;
+    nearest->k = k;
+
+    float cx = player->pos.x + player->w / 2, cy = player->pos.y + player->h / 2;
+    int found[MAX_OBSERVED];
+    int numFound = grid_query(grid, cx - WINDOW_WIDTH / 2, cy - WINDOW_HEIGHT / 2,
+        cx + WINDOW_WIDTH / 2, cy + WINDOW_HEIGHT / 2, found, MAX_OBSERVED);
+    if (numFound >= 0)
+    {
+        for (int i = 0; i < numFound; i++)
+            if (!skip || !skip[found[i]])
+                nearest_add(nearest, centre_dist(player, &rects[found[i]]), found[i]);
+    }
+    else
+    {
+        for (int i = 0; i < numRects; i++)
+            if (!skip || !skip[i])
+                nearest_add(nearest, centre_dist(player, &rects[i]), i);
+    }
+}
+
+void evader_observe(Evader const* evader, float* buf) {
+    GameWorld const* world = evader->world;
+    MovingRect const* player = &world->player;
+    memset(buf, 0, EVADER_OBS_SIZE * sizeof(*buf));
+
+    buf[0] = player->pos.x;
+    buf[1] = player->pos.y;
+    buf[2] = player->dir.x;
+    buf[3] = player->dir.y;
+    buf[4] = world->numCoinsLeft;
+    buf[5] = world->lastBulletSpawnTime + world->bulletDelay - world->time;
+    buf += EVADER_OBS_PLAYER_SIZE;
+
+    Nearest nearest = { .n = 0, .k = EVADER_OBS_BULLETS };
+    for (unsigned int i = 0; i < world->numBulletsSpawned; i++)
+        nearest_add(&nearest, centre_dist(player, &world->bullets[i].movingRect), i);
+    for (int i = 0; i < nearest.n; i++)
+    {
+        MovingRect const* bullet = &world->bullets[nearest.items[i]].movingRect;
+        float* out = buf + i * EVADER_OBS_BULLET_SIZE;
+        out[0] = 1;
+        out[1] = bullet->pos.x - player->pos.x;
+        out[2] = bullet->pos.y - player->pos.y;
+        out[3] = bullet->dir.x;
+        out[4] = bullet->dir.y;
+    }
+    buf += EVADER_OBS_BULLETS * EVADER_OBS_BULLET_SIZE;
+
+    find_nearest(&nearest, EVADER_OBS_PLATFORMS, world, &world->platformGrid,
+        world->platforms, world->numPlatforms, NULL);
+    for (int i = 0; i < nearest.n; i++)
+    {
+        MovingRect const* platform = &world->platforms[nearest.items[i]];
+        float* out = buf + i * EVADER_OBS_PLATFORM_SIZE;
+        out[0] = 1;
+        out[1] = platform->pos.x - player->pos.x;
+        out[2] = platform->pos.y - player->pos.y;
+        out[3] = platform->w;
+        out[4] = platform->h;
+    }
+    buf += EVADER_OBS_PLATFORMS * EVADER_OBS_PLATFORM_SIZE;
+
+    find_nearest(&nearest, EVADER_OBS_COINS, world, &world->coinGrid,
+        world->coins, world->numCoins, world->coinsCollected);
+    for (int i = 0; i < nearest.n; i++)
+    {
+        MovingRect const* coin = &world->coins[nearest.items[i]];
+        float* out = buf + i * EVADER_OBS_COIN_SIZE;
+        out[0] = 1;
+        out[1] = coin->pos.x - player->pos.x;
+        out[2] = coin->pos.y - player->pos.y;
+    }
+}
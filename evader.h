@@ -0,0 +1,74 @@
+#ifndef EVADER_H
+#define EVADER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Game logic as a library for training bots: the same world_step() physics the
+// game uses, stepped by hand with no SDL, window or audio. Each Evader is
+// independent, so give every thread its own.
+
+// Actions for evader_step(), OR'd together
+#define EVADER_LEFT 1u
+#define EVADER_RIGHT 2u
+#define EVADER_UP 4u
+#define EVADER_DOWN 8u
+
+// How many of the nearest of each thing evader_observe() writes
+#define EVADER_OBS_BULLETS 8
+#define EVADER_OBS_PLATFORMS 8
+#define EVADER_OBS_COINS 4
+
+// Floats per player, bullet, platform and coin in an observation
+#define EVADER_OBS_PLAYER_SIZE 6
+#define EVADER_OBS_BULLET_SIZE 5
+#define EVADER_OBS_PLATFORM_SIZE 5
+#define EVADER_OBS_COIN_SIZE 3
+
+// Length of the buffer evader_observe() fills
+#define EVADER_OBS_SIZE (EVADER_OBS_PLAYER_SIZE + \
+    EVADER_OBS_BULLETS * EVADER_OBS_BULLET_SIZE + \
+    EVADER_OBS_PLATFORMS * EVADER_OBS_PLATFORM_SIZE + \
+    EVADER_OBS_COINS * EVADER_OBS_COIN_SIZE)
+
+// What evader_step() left the game as
+typedef enum EvaderStatus {
+    EVADER_PLAYING, EVADER_WON, EVADER_LOST
+} EvaderStatus;
+
+typedef struct Evader Evader;
+
+// Allocate a game, returns NULL on failure. Call evader_reset() before stepping.
+Evader* evader_create(void);
+
+void evader_destroy(Evader* evader);
+
+// Start a new game. The same seed and actions always play out the same way,
+// and match a game played with --seed at the default tick rate.
+void evader_reset(Evader* evader, uint64_t seed);
+
+// Advance one tick (1000 / defaultTickRate ms) holding the given actions.
+// Stepping a finished game does nothing.
+EvaderStatus evader_step(Evader* evader, unsigned int actions);
+
+// Coins collected by the last evader_step(), e.g. for a reward
+int evader_coins_collected(Evader const* evader);
+
+// Write EVADER_OBS_SIZE floats describing the game to buf:
+//   player:    x, y, dx, dy, coins left, ms until the next bullet
+//   bullets:   present, x, y, dx, dy
+//   platforms: present, x, y, width, height
+//   coins:     present, x, y
+// Bullets, platforms and coins are the nearest to the player first, with
+// positions relative to the player's. Platforms and coins are looked for within
+// a window's size around the player. Missing ones are all zeros.
+void evader_observe(Evader const* evader, float* buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
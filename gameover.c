@@ -2,21 +2,31 @@
 
 #include "gameover.h"
 #include "constants.h"
-#include "audio.h"
+#include "render.h"
+#include "soundbank.h"
 
-GameState nextState;
+// Next state to transition to once the game over screen is left
+static GameState nextState;
+// Set when the window needs the frozen frame presented again
+static bool redraw;
 
-void game_over_process_input(void) {
-    SDL_Event event;
-    SDL_PollEvent(&event);
-    
-    switch (event.type) {
+void game_over_process_input(SDL_Event const* event) {
+    switch (event->type) {
     case SDL_QUIT: // e.g. click x button on window, Ctrl+C
         printf("Quit event detected\n");
         nextState = STATE_EXIT;
         break;
+    case SDL_RENDER_TARGETS_RESET:
+    case SDL_RENDER_DEVICE_RESET:
+        render_invalidate();
+        redraw = true;
+        break;
+    case SDL_WINDOWEVENT:
+        if (event->window.event == SDL_WINDOWEVENT_EXPOSED)
+            redraw = true;
+        break;
     case SDL_KEYDOWN:
-        switch (event.key.keysym.sym) {
+        switch (event->key.keysym.sym) {
         case SDLK_q:
             printf("Q pressed\n");
             nextState = STATE_EXIT;
@@ -25,30 +35,36 @@ void game_over_process_input(void) {
             nextState = STATE_MAIN;
             break;
         }
+        break;
     default:
         break;
     }
 }
 
-void game_over_update(void) {}
-
-void game_over_render(void) {}
+void game_over_render(SDL_Renderer* renderer, GameWorld const* world) {
+    if (!redraw)
+        return;
+    render_frozen(renderer, world);
+    redraw = false;
+}
 
-void game_over_loop(bool won) {
+GameState game_over_loop(SDL_Renderer* renderer, GameWorld const* world, bool won) {
 
     nextState = STATE_CONTINUE;
+    redraw = true;
 
     // Play victory/death music
-    initAudio();
-    char* sound = won ? "assets/sound/win.wav" : "assets/sound/death.wav";
-    playSound(sound, soundVolume * 1.1);
+    sound_bank_stop_music();
+    sound_bank_play(won ? SOUND_WIN : SOUND_DEATH, soundVolume * 1.1);
 
     while (nextState == STATE_CONTINUE)
     {
-        SDL_Delay(DELAY); // delay to avoid high cpu consumption
-        game_over_process_input();
-        game_over_update();
-        game_over_render();
+        game_over_render(renderer, world);
+        // Nothing changes on screen until an event arrives, so sleep until then
+        SDL_Event event;
+        if (SDL_WaitEventTimeout(&event, idleWait))
+            game_over_process_input(&event);
     }
-    endAudio();
+    render_thaw();
+    return nextState;
 }
@@ -4,11 +4,17 @@
 #include <stdbool.h>
 #include <SDL2/SDL.h>
 
+#include "constants.h"
+#include "world.h"
+
 /**
- * @brief End game (won or lost).
+ * @brief End game (won or lost), showing the final frame until a key is pressed.
  * 
+ * @param renderer renderer to present the final frame with
+ * @param world the finished game
  * @param won true if won, false if lost
+ * @return the state to go to next (restart or exit)
  */
-void game_over_loop(bool won);
+GameState game_over_loop(SDL_Renderer* renderer, GameWorld const* world, bool won);
 
 #endif
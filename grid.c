@@ -0,0 +1,140 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "grid.h"
+#include "rect.h"
+
+// Cell column of an x coordinate, clamped to the grid. Truncating rather than
+// flooring only differs below 0, which is clamped to 0 either way.
+static int cell_col(SpatialGrid const* grid, float x) {
+    int col = (int)((x - grid->origin.x) * grid->invCellW);
+    if (col < 0) return 0;
+    if (col >= grid->cols) return grid->cols - 1;
+    return col;
+}
+
+// Cell row of a y coordinate, clamped to the grid
+static int cell_row(SpatialGrid const* grid, float y) {
+    int row = (int)((y - grid->origin.y) * grid->invCellH);
+    if (row < 0) return 0;
+    if (row >= grid->rows) return grid->rows - 1;
+    return row;
+}
+
+// Grow buffer to hold at least count ints
+static bool reserve(int** buffer, int* capacity, int count) {
+    if (count <= *capacity)
+        return true;
+    int* grown = realloc(*buffer, count * sizeof(int));
+    if (!grown)
+        return false;
+    *buffer = grown;
+    *capacity = count;
+    return true;
+}
+
+bool grid_build(SpatialGrid* grid, MovingRect const* rects, int n, float cellW, float cellH) {
+    grid->cellW = cellW;
+    grid->cellH = cellH;
+    grid->invCellW = 1 / cellW;
+    grid->invCellH = 1 / cellH;
+    grid->origin.x = 0;
+    grid->origin.y = 0;
+    grid->cols = 1;
+    grid->rows = 1;
+
+    if (n > 0)
+    {
+        // Cover the bounding box of all the rectangles
+        float left = rects[0].pos.x, top = rects[0].pos.y;
+        float right = left + rects[0].w, bottom = top + rects[0].h;
+        for (int i = 1; i < n; i++)
+        {
+            left = fminf(left, rects[i].pos.x);
+            top = fminf(top, rects[i].pos.y);
+            right = fmaxf(right, rects[i].pos.x + rects[i].w);
+            bottom = fmaxf(bottom, rects[i].pos.y + rects[i].h);
+        }
+        grid->origin.x = left;
+        grid->origin.y = top;
+        grid->cols = (int)((right - left) / cellW) + 1;
+        grid->rows = (int)((bottom - top) / cellH) + 1;
+    }
+
+    int numCells = grid->cols * grid->rows;
+    if (!reserve(&grid->cellStart, &grid->cellCapacity, numCells + 1))
+        return false;
+    int* cellStart = grid->cellStart;
+    memset(cellStart, 0, (numCells + 1) * sizeof(int));
+
+    // Count the items in each cell, shifted by one so the prefix sum below
+    // leaves cellStart[c] at the start of cell c
+    for (int i = 0; i < n; i++)
+    {
+        int col0 = cell_col(grid, rects[i].pos.x), col1 = cell_col(grid, rects[i].pos.x + rects[i].w);
+        int row0 = cell_row(grid, rects[i].pos.y), row1 = cell_row(grid, rects[i].pos.y + rects[i].h);
+        for (int row = row0; row <= row1; row++)
+            for (int col = col0; col <= col1; col++)
+                cellStart[row * grid->cols + col + 1]++;
+    }
+    for (int c = 0; c < numCells; c++)
+        cellStart[c + 1] += cellStart[c];
+
+    if (!reserve(&grid->items, &grid->itemCapacity, cellStart[numCells]))
+        return false;
+
+    // Fill in the items, using cellStart[c] as the insert position of cell c
+    // then shifting back afterwards
+    for (int i = 0; i < n; i++)
+    {
+        int col0 = cell_col(grid, rects[i].pos.x), col1 = cell_col(grid, rects[i].pos.x + rects[i].w);
+        int row0 = cell_row(grid, rects[i].pos.y), row1 = cell_row(grid, rects[i].pos.y + rects[i].h);
+        for (int row = row0; row <= row1; row++)
+            for (int col = col0; col <= col1; col++)
+                grid->items[cellStart[row * grid->cols + col]++] = i;
+    }
+    for (int c = numCells; c > 0; c--)
+        cellStart[c] = cellStart[c - 1];
+    cellStart[0] = 0;
+
+    return true;
+}
+
+void grid_free(SpatialGrid* grid) {
+    free(grid->cellStart);
+    free(grid->items);
+    memset(grid, 0, sizeof(*grid));
+}
+
+int grid_query(SpatialGrid const* grid, float left, float top, float right, float bottom, int* out, int maxOut) {
+    int count = 0;
+    if (!grid->cellStart)
+        return -1;
+    int col0 = cell_col(grid, left), col1 = cell_col(grid, right);
+    int row0 = cell_row(grid, top), row1 = cell_row(grid, bottom);
+    for (int row = row0; row <= row1; row++)
+    {
+        for (int col = col0; col <= col1; col++)
+        {
+            int cell = row * grid->cols + col;
+            for (int k = grid->cellStart[cell]; k < grid->cellStart[cell + 1]; k++)
+            {
+                // Insertion sort, skipping items already found in another cell
+                int item = grid->items[k];
+                int pos = count;
+                while (pos > 0 && out[pos - 1] > item)
+                    pos--;
+                if (pos > 0 && out[pos - 1] == item)
+                    continue;
+                if (count == maxOut)
+                    return -1;
+                memmove(out + pos + 1, out + pos, (count - pos) * sizeof(int));
+                out[pos] = item;
+                count++;
+            }
+        }
+    }
+    return count;
+}
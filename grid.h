@@ -0,0 +1,37 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <stdbool.h>
+
+#include "rect.h"
+
+// Uniform grid over a fixed set of rectangles, used to find the few
+// rectangles near a point without scanning all of them.
+// Items are stored per cell in one flat array: the items in cell c are
+// items[cellStart[c]] up to (not including) items[cellStart[c + 1]].
+typedef struct SpatialGrid {
+    // Top-left corner of cell (0, 0)
+    OrderedPair origin;
+    float cellW, cellH;
+    // Multiplied by rather than dividing, as building does it for every item
+    float invCellW, invCellH;
+    int cols, rows;
+    int* cellStart;
+    int* items;
+    // Allocated lengths of cellStart and items, reused when rebuilding
+    int cellCapacity, itemCapacity;
+} SpatialGrid;
+
+// Build the grid over the given rectangles, reusing any memory from an earlier
+// build. Returns false if memory could not be allocated.
+bool grid_build(SpatialGrid* grid, MovingRect const* rects, int n, float cellW, float cellH);
+
+void grid_free(SpatialGrid* grid);
+
+// Find the rectangles in the cells overlapping the given box.
+// Writes their indices in ascending order, without duplicates, to out.
+// Returns the number written, or -1 if there were more than maxOut or the
+// grid has not been built (the caller should then check every rectangle).
+int grid_query(SpatialGrid const* grid, float left, float top, float right, float bottom, int* out, int maxOut);
+
+#endif
@@ -0,0 +1,71 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "input.h"
+
+InputStats inputStats;
+
+void input_clear(InputQueue* queue) {
+    queue->head = 0;
+    queue->count = 0;
+}
+
+// Update the key state for one event, a direction can't be pressed while
+// its opposite is held
+static void apply_event(Keys* keys, InputEvent const* event) {
+    double latency = (double)(SDL_GetPerformanceCounter() - event->time) * 1000
+        / SDL_GetPerformanceFrequency();
+    inputStats.applied++;
+    inputStats.totalLatency += latency;
+    if (latency > inputStats.maxLatency)
+        inputStats.maxLatency = latency;
+
+    switch (event->key) {
+    case INPUT_LEFT:
+        if (!event->down)
+            keys->l = false;
+        else if (!keys->r)
+            keys->l = true;
+        break;
+    case INPUT_RIGHT:
+        if (!event->down)
+            keys->r = false;
+        else if (!keys->l)
+            keys->r = true;
+        break;
+    case INPUT_UP:
+        if (!event->down)
+            keys->u = false;
+        else if (!keys->d)
+            keys->u = true;
+        break;
+    case INPUT_DOWN:
+        if (!event->down)
+            keys->d = false;
+        else if (!keys->u)
+            keys->d = true;
+        break;
+    }
+}
+
+void input_push(InputQueue* queue, Keys* keys, InputEvent event) {
+    if (queue->count == INPUT_QUEUE_SIZE)
+    {
+        apply_event(keys, &queue->events[queue->head]);
+        queue->head = (queue->head + 1) % INPUT_QUEUE_SIZE;
+        queue->count--;
+        inputStats.overflowed++;
+    }
+    queue->events[(queue->head + queue->count) % INPUT_QUEUE_SIZE] = event;
+    queue->count++;
+}
+
+void input_apply(InputQueue* queue, Keys* keys, uint64_t time) {
+    while (queue->count > 0 && queue->events[queue->head].time <= time)
+    {
+        apply_event(keys, &queue->events[queue->head]);
+        queue->head = (queue->head + 1) % INPUT_QUEUE_SIZE;
+        queue->count--;
+    }
+}
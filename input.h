@@ -0,0 +1,59 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "world.h"
+
+// Max movement key events waiting to be applied, more than this in one frame
+// and the oldest are applied straight away
+#define INPUT_QUEUE_SIZE 64
+
+// Movement keys, the only input that feeds into world_step()
+typedef enum InputKey {
+    INPUT_LEFT,
+    INPUT_RIGHT,
+    INPUT_UP,
+    INPUT_DOWN
+} InputKey;
+
+// One key press or release
+typedef struct InputEvent {
+    // Performance counter value when the key was pressed or released
+    uint64_t time;
+    InputKey key;
+    bool down;
+} InputEvent;
+
+// How long input waits between happening and reaching the simulation
+typedef struct InputStats {
+    // Events applied
+    unsigned long applied;
+    // Events applied early because the queue was full
+    unsigned long overflowed;
+    // Total and worst time from the event happening to being applied, in ms
+    double totalLatency;
+    double maxLatency;
+} InputStats;
+
+// Ring buffer of movement key events in the order they happened
+typedef struct InputQueue {
+    InputEvent events[INPUT_QUEUE_SIZE];
+    // Index of the oldest event and number of events queued
+    int head, count;
+} InputQueue;
+
+extern InputStats inputStats;
+
+// Empty the queue
+void input_clear(InputQueue* queue);
+
+// Queue an event. If the queue is full, the oldest event is applied to keys first.
+void input_push(InputQueue* queue, Keys* keys, InputEvent event);
+
+// Apply every queued event that happened at or before time (a performance
+// counter value) to keys, in order
+void input_apply(InputQueue* queue, Keys* keys, uint64_t time);
+
+#endif
@@ -10,51 +10,85 @@
 // SDL2 wiki: wiki.libsdl.org
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <SDL2/SDL.h>
 #include <stdbool.h>
 #include <signal.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
 
 #include "constants.h"
 #include "rect.h"
 #include "mysdl.h"
 #include "gameover.h"
 #include "audio.h"
-
-#if ENABLE_LOG
-#include <stdio.h>
-#endif
+#include "world.h"
+#include "timing.h"
+#include "render.h"
+#include "input.h"
+#include "soundbank.h"
+#include "bench.h"
+#include "replay.h"
+#include "rng.h"
+#include "batch.h"
+#include "bot.h"
 
 SDL_Window* window = NULL;
 SDL_Renderer* renderer = NULL;
 
-GameState nextState;
-
-// Time of last frame update in ms
-Time lastFrameTime;
-// Time of last bullet spawn in ms
-Time lastBulletSpawnTime;
-// Time to wait before spawning next bullet
-Time bulletDelay;
-
-MovingRect player;
-// Which keys are currently pressed
-struct Keys {
-    bool l, r, u, d;
-} keys;
-
-Bullet bullets[MAX_BULLETS];
-unsigned int numBulletsSpawned;
-int nextBulletNum;
-
-MovingRect platforms[NUM_PLATFORMS];
-// Big wall of red below all the platforms, touch it and you die
-MovingRect lava;
-
-MovingRect coins[NUM_COINS];
-int numCoinsLeft;
-bool coinsCollected[NUM_COINS];
+// Command line options
+typedef struct Options {
+    bool headless;
+    // Endless level, see chunk.h
+    bool endless;
+    // Print performance counters after each game
+    bool stats;
+    // Number of ticks to simulate in headless mode
+    unsigned long ticks;
+    // Simulation steps per second
+    unsigned int tickRate;
+    int maxStepsPerFrame;
+    // Frames per second to aim for, 0 for no limit
+    unsigned int fps;
+    // Let the display's refresh rate pace frames
+    bool vsync;
+    // Busy-wait for the last this many ms before each frame
+    double spinMs;
+    // Microbenchmark to run instead of the game, NULL for none
+    char const* bench;
+    // WAVE file to render the audio script to with no audio device, NULL for none
+    char const* renderAudio;
+    // File to save each game's replay to, NULL for none
+    char const* record;
+    // Replay to play back headless instead of the game, NULL for none
+    char const* replay;
+    // Seed the first game's level with seed, if seeded
+    bool seeded;
+    uint64_t seed;
+    // Games to run in a batch instead of the game, 0 for none
+    unsigned long batchGames;
+    // Batch threads, 0 for one per CPU
+    int threads;
+    BotPolicy policy;
+    // Longest a batch game runs in ticks
+    unsigned long gameTicks;
+    // Difficulty of batch games
+    WorldParams params;
+    // Frames per audio buffer, 0 for the audio code's default
+    unsigned int audioBuffer;
+} Options;
+
+Options options;
+
+// Set when the window loses focus or is minimised, or P is pressed.
+// Nothing is simulated or redrawn until P is pressed again.
+bool paused = false;
+
+// Set when B is pressed. Bullet hell starts on the next tick so replays can
+// record exactly when.
+bool bulletHell = false;
 
 #if ENABLE_LOG
 
@@ -100,7 +134,7 @@ bool init_sdl(void) {
     renderer = SDL_CreateRenderer(
         window,
         -1, // driver code, use default
-        0 // flags
+        options.vsync ? SDL_RENDERER_PRESENTVSYNC : 0 // flags
     );
     if (!renderer)
     {
@@ -112,172 +146,129 @@ bool init_sdl(void) {
 }
 
 // Destroy SDL renderer and window, end music, exit
-void exit_game(void) {
+void exit_game(GameWorld* world) {
     log_msg("Destroying window\n");
     // destroying in reverse order of creation
-    // endAudio();
+    world_destroy(world);
+    endAudio();
+    sound_bank_free();
+    render_free();
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
     exit(EXIT_SUCCESS);
 }
 
-// Game over, won or lost
-void game_over(bool won) {
-    log_msg("Game over\n");
-    nextState = won ? STATE_GAME_OVER_WON : STATE_GAME_OVER_LOST;
+// A seed that is different every time, for a new game
+uint64_t random_seed(void) {
+    // Different every call even within one clock tick
+    static uint64_t calls;
+    return rng_hash((uint64_t)time(NULL) ^ SDL_GetPerformanceCounter(), calls++);
+}
+
+// Seed for a new game. With --seed the first game uses it and later ones are
+// derived from it, so a whole session generates the same levels again.
+uint64_t next_seed(void) {
+    static unsigned long games;
+    if (!options.seeded)
+        return random_seed();
+    unsigned long game = games++;
+    return game == 0 ? options.seed : rng_hash(options.seed, game);
 }
 
 /**
  * @brief Set initial state before looping
  * 
  */
-void setup(void) {
-
-    initAudio();
-    playMusic("assets/sound/bgm.wav", soundVolume);
-
-    Time startTime = SDL_GetTicks64();
-    lastFrameTime = startTime;
-    nextState = STATE_CONTINUE;
+void setup(GameWorld* world, Keys* keys) {
 
-    lastBulletSpawnTime = startTime;
-    nextBulletNum = 0;
-    numBulletsSpawned = 0;
+    sound_bank_play(SOUND_BGM, soundVolume);
 
-    memset(&keys, false, sizeof(keys));
-
-    player.pos.x = 0;
-    player.pos.y = 0;
-    player.w = PLAYER_SIZE;
-    player.h = PLAYER_SIZE;
-    player.dir.x = 0;
-    player.dir.y = 0;
-
-    bulletDelay = maxBulletDelay;
-
-    // Choose locations for coins
-    // Which platforms have coins above them
-    bool hasCoin[NUM_PLATFORMS];
-    memset(hasCoin, false, sizeof(hasCoin));
-    for (int i = 0; i < NUM_COINS; i++)
-    {
-        int spotsRemaining = NUM_PLATFORMS - i;
-        int nextCoin = arc4random_uniform(spotsRemaining);
-        int j = -1, count = -1;
-        while (count != nextCoin)
-        {
-            j++;
-            if (!hasCoin[j])
-                count++;
-        }
-        hasCoin[j] = true;
-    }
-
-    memset(coinsCollected, false, sizeof(coinsCollected));
-    int coinCount = 0;
-    numCoinsLeft = NUM_COINS;
-
-    // Create platforms, spread in grid with some random variation
-    for (size_t i = 0; i < NUM_PLATFORMS; i++)
-    {
-        // No movement for platforms
-        platforms[i].dir.x = 0;
-        platforms[i].dir.y = 0;
-
-        // Positioning
-        int col = i % PLATFORM_GRID_SIZE;
-        int row = i / PLATFORM_GRID_SIZE;
-        platforms[i].pos.x = col * (platformSeparation + platformWidth) + arc4random_uniform(platformSeparation);
-        platforms[i].pos.y = row * (platformSeparation + platformHeight) + arc4random_uniform(platformSeparation);
-
-        // Size
-        platforms[i].w = platformWidth;
-        platforms[i].h = platformHeight;
-
-        // Spawn player above starting platform
-        if (row == 0 && col == PLATFORM_GRID_SIZE / 2)
-        {
-            player.pos = platforms[i].pos;
-            player.pos.y -= platformSeparation;
-        }
-
-        // Spawn coin if needed
-        if (hasCoin[i])
-        {
-            coins[coinCount].dir.x = 0;
-            coins[coinCount].dir.y = 0;
-            coins[coinCount].pos = platforms[i].pos;
-            coins[coinCount].pos.y -= platformHeight + 1;
-            coins[coinCount].pos.x += (platformWidth - coinSize) / 2;
-            coins[coinCount].w = coinSize;
-            coins[coinCount].h = coinSize;
-            coinCount++;
-        }
-    }
+    memset(keys, false, sizeof(*keys));
+    bulletHell = false;
+    world->endless = options.endless;
+    world->seed = next_seed();
+    world_setup(world);
+    memset(&renderStats, 0, sizeof(renderStats));
+    memset(&inputStats, 0, sizeof(inputStats));
+}
 
-    // Create lava
-    lava.pos.y = PLATFORM_GRID_SIZE * (platformSeparation + platformHeight) + WINDOW_HEIGHT; // add
-    // window height to ensure it is out of view
-    int platformAreaWidth = PLATFORM_GRID_SIZE * (platformSeparation + platformWidth);
-    lava.pos.x = -platformAreaWidth;
-    lava.w = platformAreaWidth * 3;
-    lava.h = lava.w;
-    lava.dir.x = 0;
-    lava.dir.y = 0;
+// Performance counter value an event happened at. SDL only stamps events in
+// ms, so work back from how long ago that was.
+uint64_t event_time(Uint32 timestamp, uint64_t nowCounter, Uint32 nowTicks) {
+    uint64_t age = (Uint32)(nowTicks - timestamp);
+    uint64_t ageCounter = age * SDL_GetPerformanceFrequency() / 1000;
+    return ageCounter < nowCounter ? nowCounter - ageCounter : 0;
 }
 
-void process_input(void) {
-    SDL_Event event;
-    SDL_PollEvent(&event);
-    
-    switch (event.type) {
+// Handle one event. Movement keys are queued with the time they happened so
+// each reaches the simulation step it belongs to. Returns true if the window
+// needs redrawing.
+bool handle_event(GameWorld* world, Keys* keys, InputQueue* queue, SDL_Event const* event,
+        uint64_t nowCounter, Uint32 nowTicks) {
+    InputEvent input;
+    input.time = event_time(event->common.timestamp, nowCounter, nowTicks);
+    input.down = event->type == SDL_KEYDOWN;
+    switch (event->type) {
     case SDL_QUIT: // click x button on window
         log_msg("Quit event detected\n");
-        nextState = STATE_EXIT;
+        world->state = STATE_EXIT;
+        break;
+    case SDL_RENDER_TARGETS_RESET:
+    case SDL_RENDER_DEVICE_RESET:
+        // Cached textures lost their contents
+        render_invalidate();
+        return true;
+    case SDL_WINDOWEVENT:
+        switch (event->window.event) {
+        case SDL_WINDOWEVENT_FOCUS_LOST:
+        case SDL_WINDOWEVENT_MINIMIZED:
+            paused = true;
+            break;
+        case SDL_WINDOWEVENT_EXPOSED:
+            return true;
+        default:
+            break;
+        }
         break;
     case SDL_KEYDOWN:
-        switch (event.key.keysym.sym) {
+    case SDL_KEYUP:
+        switch (event->key.keysym.sym) {
         case SDLK_q:
-            log_msg("Q pressed\n");
-            nextState = STATE_EXIT;
+            if (input.down)
+            {
+                log_msg("Q pressed\n");
+                world->state = STATE_EXIT;
+            }
             break;
         case SDLK_r:
-            nextState = STATE_MAIN;
+            if (input.down)
+                world->state = STATE_MAIN;
+            break;
+        case SDLK_p:
+            if (input.down && !event->key.repeat)
+                paused = !paused;
             break;
         case SDLK_b:
             // Bullet hell
-            bulletDelay = 100;
-            break;
-        case SDLK_LEFT:
-            if (!keys.r) keys.l = true;
-            break;
-        case SDLK_RIGHT:
-            if (!keys.l) keys.r = true;
-            break;
-        case SDLK_UP:
-            if (!keys.d) keys.u = true;
-            break;
-        case SDLK_DOWN:
-            if (!keys.u) keys.d = true;
+            if (input.down)
+                bulletHell = true;
             break;
-        default:
-            break;
-        }
-        break;
-    case SDL_KEYUP:
-        switch (event.key.keysym.sym) {
         case SDLK_LEFT:
-            keys.l = false;
+            input.key = INPUT_LEFT;
+            input_push(queue, keys, input);
             break;
         case SDLK_RIGHT:
-            keys.r = false;
+            input.key = INPUT_RIGHT;
+            input_push(queue, keys, input);
             break;
         case SDLK_UP:
-            keys.u = false;
+            input.key = INPUT_UP;
+            input_push(queue, keys, input);
             break;
         case SDLK_DOWN:
-            keys.d = false;
+            input.key = INPUT_DOWN;
+            input_push(queue, keys, input);
             break;
         default:
             break;
@@ -286,266 +277,379 @@ void process_input(void) {
     default:
         break;
     }
+    return false;
 }
 
-// Spawn a new bullet, crash if no more space for a bullet
-void spawn_bullet(void)
-{
-    size_t i = nextBulletNum;
-    nextBulletNum++;
-    if (nextBulletNum == MAX_BULLETS)
-        nextBulletNum = 0;
-    if (numBulletsSpawned < MAX_BULLETS)
-        numBulletsSpawned++;
-    Bullet* bullet = bullets + i;
-
-    bullet->movingRect.w = BULLET_SIZE;
-    bullet->movingRect.h = BULLET_SIZE;
-
-    // Random bullet spawn location
-    OrderedPair pos;
-    if (arc4random_uniform(2) == 0)
+// Handle every pending event
+void process_input(GameWorld* world, Keys* keys, InputQueue* queue) {
+    uint64_t nowCounter = SDL_GetPerformanceCounter();
+    Uint32 nowTicks = SDL_GetTicks();
+    SDL_Event event;
+    while (SDL_PollEvent(&event))
     {
-        // spawn on top/bottom edge
-        pos.y = player.pos.y + WINDOW_HEIGHT / 2 * pow(-1, arc4random_uniform(2));
-        pos.x = player.pos.x - WINDOW_WIDTH / 2 + arc4random_uniform(WINDOW_WIDTH);
-    } else {
-        // spawn on left-right edge
-        pos.x = player.pos.x + WINDOW_WIDTH / 2 * pow(-1, arc4random_uniform(2));
-        pos.y = player.pos.y - WINDOW_HEIGHT / 2 + arc4random_uniform(WINDOW_HEIGHT);
+        handle_event(world, keys, queue, &event, nowCounter, nowTicks);
     }
-    bullet->movingRect.pos = pos;
-
-    // Bullet goes toward player
-    bullet->movingRect.dir = scaled_vector(relative_pos(player.pos, bullet->movingRect.pos), playerHorizontalSpeed);
 }
 
-/**
- * @brief Update game state after getting input
- * 
- */
-void update(void) {
-
-    Time currentTime = SDL_GetTicks64();
-    Time delta = currentTime - lastFrameTime;
-    lastFrameTime = currentTime;
-    // Should I spawn a bullet on this iteration?
-    bool spawnBullet = false;
-    if (currentTime > lastBulletSpawnTime + bulletDelay)
+// Show the frozen game, sleeping until an event arrives, until unpaused
+void pause_loop(GameWorld* world, Keys* keys, InputQueue* queue) {
+    log_msg("Paused\n");
+    // Key releases may never arrive while the window is unfocused
+    memset(keys, false, sizeof(*keys));
+    input_clear(queue);
+    render_frozen(renderer, world);
+    while (paused && world->state == STATE_CONTINUE)
     {
-        lastBulletSpawnTime = currentTime;
-        spawnBullet = true;
+        SDL_Event event;
+        if (!SDL_WaitEventTimeout(&event, idleWait))
+            continue;
+        if (handle_event(world, keys, queue, &event, SDL_GetPerformanceCounter(), SDL_GetTicks()))
+            render_frozen(renderer, world);
     }
+    render_thaw();
+}
 
-    if (spawnBullet)
-    {
-        spawn_bullet();
-    }
+void update(GameWorld* world, Keys const* keys, float delta) {
+    world_step(world, keys, delta);
+    if (world->state == STATE_GAME_OVER_WON || world->state == STATE_GAME_OVER_LOST)
+        log_msg("Game over\n");
+    if (world->events.coinsCollected > 0 && world->state != STATE_GAME_OVER_WON)
+        sound_bank_play(SOUND_COIN, soundVolume);
+}
+
+// Print the performance counters gathered during the last game
+void print_stats(void) {
+    unsigned long frames = renderStats.frames ? renderStats.frames : 1;
+    printf("%lu frames, %.1f rects drawn and %.1f culled per frame in %.1f fill calls\n",
+        renderStats.frames, (double)renderStats.drawn / frames, (double)renderStats.culled / frames,
+        (double)renderStats.calls / frames);
+    unsigned long applied = inputStats.applied ? inputStats.applied : 1;
+    printf("%lu key events, %.2f ms average and %.2f ms worst input latency, %lu applied early\n",
+        inputStats.applied, inputStats.totalLatency / applied, inputStats.maxLatency,
+        inputStats.overflowed);
+    AudioStats audio;
+    getAudioStats(&audio);
+    printf("%u audio callbacks of %u frames (%u us each): %u us average, %u us worst, %u overran, %u music underruns\n",
+        audio.callbacks, audio.samples, audio.deadlineUs, audio.averageUs, audio.worstUs, audio.overruns,
+        audio.underruns);
+}
 
-    // Set player velocity
-    player.dir.x = 0;
-    if (keys.l) player.dir.x = -playerHorizontalSpeed;
-    else if (keys.r) player.dir.x = playerHorizontalSpeed;
-    player.dir.y += gravity;
-    // Don't exceed terminal velocity
-    if (player.dir.y > terminalVelocity)
-        player.dir.y = terminalVelocity;
-    bool onPlatform = false;
-    for (size_t i = 0; i < NUM_PLATFORMS; i++)
+void main_loop(SDL_Renderer* renderer, GameWorld* world) {
+    Keys keys;
+    InputQueue queue;
+    input_clear(&queue);
+    paused = false;
+    setup(world, &keys);
+    FixedStep step;
+    fixed_step_init(&step, options.tickRate, options.maxStepsPerFrame);
+    FramePacer pacer;
+    frame_pacer_init(&pacer, options.fps, options.spinMs);
+    Replay replay;
+    replay_init(&replay, world->seed, options.tickRate, world->endless);
+    while (world->state == STATE_CONTINUE)
     {
-        if (would_collide(player, platforms[i], delta) == EDGE_BOTTOM)
+        frame_pacer_wait(&pacer); // wait out the rest of the frame to avoid high cpu consumption
+        process_input(world, &keys, &queue);
+        if (paused)
         {
-            onPlatform = true;
-            player.pos.y = platforms[i].pos.y - PLAYER_SIZE - 0.0001;
-            player.dir.y = 0;
-            break;
+            pause_loop(world, &keys, &queue);
+            // Don't try to simulate the time spent paused
+            fixed_step_reset(&step);
+            continue;
         }
-    }
-    if (onPlatform && keys.u)
-        player.dir.y = -playerJumpSpeed;
-    
-    // Collecting coins
-    for (size_t i = 0; i < NUM_COINS; i++)
-    {
-        if (!coinsCollected[i] && would_collide(player, coins[i], delta) != EDGE_NONE)
+        // Run as many fixed-length steps as real time has passed
+        int steps = fixed_step_advance(&step);
+        for (int i = 0; i < steps && world->state == STATE_CONTINUE; i++)
         {
-            // Coin collected
-            numCoinsLeft--;
-            coinsCollected[i] = true;
-            if (NUM_COINS != 1)
+            // Only input from before this step started counts for it
+            input_apply(&queue, &keys, fixed_step_time(&step, steps - i));
+            if (bulletHell)
+                world_bullet_hell(world);
+            if (options.record && !replay_record(&replay, replay_pack(&keys, bulletHell)))
             {
-                // Avoid division by 0
-                bulletDelay -= (maxBulletDelay - minBulletDelay) / (NUM_COINS - 1);
+                log_err("Out of memory recording, not saving replay\n");
+                options.record = NULL;
             }
-            if (numCoinsLeft == 0)
-                game_over(true);
-            else
-                playSound("assets/sound/coin.wav", soundVolume);
+            bulletHell = false;
+            update(world, &keys, step.stepMs);
         }
+        render(renderer, world);
     }
-    
-    // Move bullets
-    for (size_t i = 0; i < numBulletsSpawned; i++) {
-        if (
-            would_collide(player, bullets[i].movingRect, delta) != EDGE_NONE
-            && nextState == STATE_CONTINUE
-        )
+    // Each game replaces the last one's replay
+    if (options.record)
+        replay_save(&replay, options.record);
+    replay_free(&replay);
+    if (options.stats)
+        print_stats();
+}
+
+/**
+ * @brief Run the simulation with no window, renderer or audio device.
+ * Games that end are restarted until the tick budget is used up.
+ * 
+ * @param ticks number of world steps to run
+ * @param tickRate simulation steps per simulated second
+ */
+void run_headless(unsigned long ticks, unsigned int tickRate) {
+    GameWorld* world = world_create();
+    if (!world)
+    {
+        fprintf(stderr, "Error allocating world\n");
+        exit(EXIT_FAILURE);
+    }
+    Keys keys;
+    memset(&keys, false, sizeof(keys));
+    unsigned long games = 0, won = 0;
+    float stepMs = 1000.0f / tickRate;
+
+    Time start = SDL_GetPerformanceCounter();
+    world->endless = options.endless;
+    world->seed = next_seed();
+    world_setup(world);
+    for (unsigned long i = 0; i < ticks; i++)
+    {
+        world_step(world, &keys, stepMs);
+        if (world->state != STATE_CONTINUE)
         {
-            // Player collided with bullet
-            game_over(false);
+            games++;
+            if (world->state == STATE_GAME_OVER_WON)
+                won++;
+            world->seed = next_seed();
+            world_setup(world);
         }
-        move_rect(&(bullets[i].movingRect), delta);
     }
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
 
-    // Collision with lava
-    if (would_collide(player, lava, delta) != EDGE_NONE)
-    {
-        game_over(false);
-    }
-    
-    // Move player
-    move_rect(&player, delta);
+    printf("%lu ticks in %.3f s (%.0f ticks/s)\n", ticks, seconds, ticks / seconds);
+    printf("%lu games finished: %lu won, %lu lost\n", games, won, games - won);
+    world_destroy(world);
 }
 
-void draw_smile(void) {
-    MovingRect smile[5];
-    // Left eye
-    smile[0].pos.x = -2;
-    smile[0].pos.y = -2;
-    smile[0].w = 1;
-    smile[0].h = 1;
-    // Right eye
-    smile[1].pos.x = 1;
-    smile[1].pos.y = -2;
-    smile[1].w = 1;
-    smile[1].h = 1;
-    // Left side of mouth
-    smile[2].pos.x = -2;
-    smile[2].pos.y = 0;
-    smile[2].w = 1;
-    smile[2].h = 2;
-    // Right side of mouth
-    smile[3].pos.x = 1;
-    smile[3].pos.y = 0;
-    smile[3].w = 1;
-    smile[3].h = 2;
-    // Bottom of mouth
-    smile[4].pos.x = -1;
-    smile[4].pos.y = 1;
-    smile[4].w = 2;
-    smile[4].h = 1;
-    // Draw
-    set_render_colour(renderer, faceColour);
-    for (int i = 0; i < 5; i++)
+/**
+ * @brief Play a recorded game back with no window, renderer or audio device,
+ * as fast as possible, and report how it ended.
+ * 
+ * @param path replay file saved with --record
+ */
+void run_replay(char const* path) {
+    Replay replay;
+    if (!replay_load(&replay, path))
     {
-        smile[i].dir.x *= facePixelSize;
-        smile[i].dir.y *= facePixelSize;
-        smile[i].pos.x *= facePixelSize;
-        smile[i].pos.y *= facePixelSize;
-        smile[i].w *= facePixelSize;
-        smile[i].h *= facePixelSize;
-        fill_rect(renderer, smile[i]);
+        replay_free(&replay);
+        exit(EXIT_FAILURE);
     }
-}
-
-void render(SDL_Renderer* renderer) {
-    set_render_colour(renderer, bgColour);
-    SDL_RenderClear(renderer);
-
-    // Draw player
-    set_render_colour(renderer, playerColour);
-    fill_rect_relative(renderer, player, player.pos); // always draw player at centre of screen
-
-    // Draw bullets
-    set_render_colour(renderer, bulletColour);
-    for (size_t i = 0; i < numBulletsSpawned; i++) {
-        fill_rect_relative(renderer, bullets[i].movingRect, player.pos);
+    GameWorld* world = world_create();
+    if (!world)
+    {
+        fprintf(stderr, "Error allocating world\n");
+        exit(EXIT_FAILURE);
     }
-
-    // Draw platforms
-    set_render_colour(renderer, platformColour);
-    for (size_t i = 0; i < NUM_PLATFORMS; i++)
+    Keys keys;
+    float stepMs = 1000.0f / replay.tickRate;
+    unsigned long i;
+
+    Time start = SDL_GetPerformanceCounter();
+    world->endless = replay.endless;
+    world->seed = replay.seed;
+    world_setup(world);
+    for (i = 0; i < replay.numTicks && world->state == STATE_CONTINUE; i++)
     {
-        fill_rect_relative(renderer, platforms[i], player.pos);
+        replay_unpack(replay.ticks[i], &keys);
+        if (replay.ticks[i] & REPLAY_BULLET_HELL)
+            world_bullet_hell(world);
+        world_step(world, &keys, stepMs);
     }
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+    char const* outcome = world->state == STATE_GAME_OVER_WON ? "won"
+        : world->state == STATE_GAME_OVER_LOST ? "lost" : "still playing";
+    printf("%lu of %lu ticks in %.3f s (%.0f ticks/s)\n", i, replay.numTicks, seconds, i / seconds);
+    printf("Seed %llu at %u Hz: %s after %.1f s with %d coins left\n", (unsigned long long)replay.seed,
+        replay.tickRate, outcome, world->time / 1000, world->numCoinsLeft);
+    if (i < replay.numTicks)
+        printf("The game ended before the recording did, so it no longer plays out the same\n");
+    world_destroy(world);
+    replay_free(&replay);
+}
 
-    // Draw lava
-    set_render_colour(renderer, bulletColour);
-    fill_rect_relative(renderer, lava, player.pos);
+void usage(char const* program) {
+    fprintf(stderr, "Usage: %s [--headless] [--endless] [--stats] [--ticks N] [--tick-rate HZ] [--max-catch-up N]\n"
+        "       [--fps N] [--vsync] [--spin-ms MS] [--bench mixer|rng|collide|jump|setup|step]\n"
+        "       [--audio-buffer FRAMES] [--low-latency] [--render-audio FILE]\n"
+        "       [--record FILE] [--replay FILE] [--seed N]\n"
+        "       [--batch GAMES] [--threads N] [--policy idle|random|bot] [--game-ticks N]\n"
+        "       [--jump-speed F] [--gravity F] [--min-bullet-delay MS] [--max-bullet-delay MS]\n", program);
+    exit(EXIT_FAILURE);
+}
 
-    // Draw coins
-    set_render_colour(renderer, coinColour);
-    for (int i = 0; i < NUM_COINS; i++)
+int main(int argc, char** argv) {
+    options.ticks = 10000;
+    options.tickRate = defaultTickRate;
+    options.maxStepsPerFrame = defaultMaxStepsPerFrame;
+    options.fps = defaultFps;
+    options.policy = POLICY_SEEKER;
+    world_default_params(&options.params);
+    bool fpsGiven = false;
+    for (int i = 1; i < argc; i++)
     {
-        if (!coinsCollected[i])
+        if (strcmp(argv[i], "--headless") == 0)
+            options.headless = true;
+        else if (strcmp(argv[i], "--endless") == 0)
+            options.endless = true;
+        else if (strcmp(argv[i], "--stats") == 0)
+            options.stats = true;
+        else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc)
+            options.ticks = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc)
+            options.tickRate = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--max-catch-up") == 0 && i + 1 < argc)
+            options.maxStepsPerFrame = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+        {
+            options.fps = strtoul(argv[++i], NULL, 10);
+            fpsGiven = true;
+        }
+        else if (strcmp(argv[i], "--vsync") == 0)
+            options.vsync = true;
+        else if (strcmp(argv[i], "--spin-ms") == 0 && i + 1 < argc)
+            options.spinMs = atof(argv[++i]);
+        else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+            options.bench = argv[++i];
+        else if (strcmp(argv[i], "--render-audio") == 0 && i + 1 < argc)
+            options.renderAudio = argv[++i];
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            options.record = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            options.replay = argv[++i];
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
         {
-            fill_rect_relative(renderer, coins[i], player.pos);
+            options.seeded = true;
+            options.seed = strtoull(argv[++i], NULL, 10);
         }
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+            options.batchGames = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            options.threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc)
+        {
+            if (!bot_policy_from_name(argv[++i], &options.policy))
+                usage(argv[0]);
+        }
+        else if (strcmp(argv[i], "--game-ticks") == 0 && i + 1 < argc)
+            options.gameTicks = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--jump-speed") == 0 && i + 1 < argc)
+            options.params.playerJumpSpeed = atof(argv[++i]);
+        else if (strcmp(argv[i], "--gravity") == 0 && i + 1 < argc)
+            options.params.gravity = atof(argv[++i]);
+        else if (strcmp(argv[i], "--min-bullet-delay") == 0 && i + 1 < argc)
+            options.params.minBulletDelay = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--max-bullet-delay") == 0 && i + 1 < argc)
+            options.params.maxBulletDelay = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--audio-buffer") == 0 && i + 1 < argc)
+            options.audioBuffer = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--low-latency") == 0)
+            options.audioBuffer = lowLatencyAudioBuffer;
+        else
+            usage(argv[0]);
+    }
+    if (options.tickRate == 0 || options.maxStepsPerFrame < 1 || options.spinMs < 0)
+        usage(argv[0]);
+    // A replay only plays out the same with the seed it was recorded with
+    if (options.replay && options.seeded)
+    {
+        fprintf(stderr, "--seed can't be used with --replay, which uses the seed it was recorded with\n");
+        usage(argv[0]);
+    }
+    // Audio buffers must be a power of 2 frames
+    if (options.audioBuffer && (options.audioBuffer < 64 || options.audioBuffer > 8192
+            || (options.audioBuffer & (options.audioBuffer - 1)) != 0))
+        usage(argv[0]);
+    // With vsync, presenting already waits for the display unless asked otherwise
+    if (options.vsync && !fpsGiven)
+        options.fps = 0;
+
+    if (options.bench)
+    {
+        if (!bench_run(options.bench))
+            usage(argv[0]);
+        return 0;
     }
 
-    // Draw coin display
-    for (int i = 0; i < NUM_COINS; i++)
+    if (options.renderAudio)
     {
-        Colour colour = (i < numCoinsLeft) ? coinColour : greyCoinColour;
-        int row = i / COIN_DISPLAY_GRID_SIZE;
-        int col = i % COIN_DISPLAY_GRID_SIZE;
-        set_render_colour(renderer, colour);
-        MovingRect coin;
-        coin.pos.x = coinDisplayWidth * (1 + col * 2);
-        coin.pos.y = coinDisplayWidth * (1 + row * 2);
-        coin.w = coinDisplayWidth;
-        coin.h = coinDisplayWidth;
-        fill_rect_standard(renderer, coin);
+        if (options.audioBuffer)
+            setAudioBufferSize(options.audioBuffer);
+        return bench_render_audio(options.renderAudio) ? 0 : EXIT_FAILURE;
     }
 
-    if (nextState == STATE_GAME_OVER_WON)
+    if (options.batchGames)
     {
-        draw_smile();
+        BatchConfig batch;
+        batch.games = options.batchGames;
+        batch.maxTicks = options.gameTicks ? options.gameTicks : (unsigned long)batchGameTime * options.tickRate;
+        batch.tickRate = options.tickRate;
+        batch.seed = options.seeded ? options.seed : random_seed();
+        batch.endless = options.endless;
+        batch.params = options.params;
+        batch.policy = options.policy;
+        batch.threads = options.threads;
+        return batch_run(&batch) ? 0 : EXIT_FAILURE;
     }
 
-    SDL_RenderPresent(renderer); // buffer swap
-}
+    if (options.replay)
+    {
+        run_replay(options.replay);
+        return 0;
+    }
 
-void main_loop(SDL_Renderer* renderer) {
-    setup();
-    while (nextState == STATE_CONTINUE)
+    if (options.headless)
     {
-        SDL_Delay(DELAY); // delay to avoid high cpu consumption
-        process_input();
-        update();
-        render(renderer);
+        run_headless(options.ticks, options.tickRate);
+        return 0;
     }
-    endAudio();
-}
 
-int main(void) {
     #if !ENABLE_LOG
-    int devnull = open("/dev/null", O_WRONLY);
-    dup2(devnull, 1);
-    dup2(devnull, 2);
-    close(devnull);
+    if (!options.stats)
+    {
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, 1);
+        dup2(devnull, 2);
+        close(devnull);
+    }
     #endif
     log_msg("Game running\n");
     if (!init_sdl()) {
         exit(EXIT_FAILURE);
     }
-    nextState = STATE_MAIN;
+    // Keep one audio device open for the whole run, then load every sound up
+    // front in its format so playing one never touches the disk or converts
+    if (options.audioBuffer)
+        setAudioBufferSize(options.audioBuffer);
+    initAudio();
+    sound_bank_load();
+    GameWorld* world = world_create();
+    if (!world) {
+        log_err("Error allocating world\n");
+        exit(EXIT_FAILURE);
+    }
+    GameState nextState = STATE_MAIN;
 
     while (1)
     {
         switch (nextState)
         {
         case STATE_EXIT:
-            exit_game();
+            exit_game(world);
             return 0;
         case STATE_MAIN:
-            main_loop(renderer);
+            main_loop(renderer, world);
+            nextState = world->state;
             break;
         case STATE_GAME_OVER_WON:
-            game_over_loop(true);
+            nextState = game_over_loop(renderer, world, true);
             break;
         case STATE_GAME_OVER_LOST:
-            game_over_loop(false);
+            nextState = game_over_loop(renderer, world, false);
             break;
         default:
             break;
@@ -0,0 +1,124 @@
+#include <stdint.h>
+
+#include "mixer.h"
+
+// Scale one sample by a ramped gain
+static inline int32_t scale(int16_t sample, int32_t gain) {
+    return (sample * (gain >> MIX_RAMP_BITS)) >> MIX_GAIN_BITS;
+}
+
+// Gain frames after gain. Wraps rather than overflowing, since vector lanes
+// past the end of a steep ramp are worked out but never used.
+static inline int32_t gain_after(int32_t gain, int32_t gainStep, int frames) {
+    return (int32_t)((uint32_t)gain + (uint32_t)frames * (uint32_t)gainStep);
+}
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+// Lanes of 8 samples hold 8 / channels frames, lane k being frame k / channels
+// of the group. Gains are kept per lane as 32-bit ramped gains and advanced
+// by a whole group at a time.
+__attribute__((target("sse2")))
+static __m128i lane_gains_sse2(int32_t gain, int32_t gainStep, int channels, int first) {
+    return _mm_setr_epi32(
+        gain_after(gain, gainStep, (first + 0) / channels), gain_after(gain, gainStep, (first + 1) / channels),
+        gain_after(gain, gainStep, (first + 2) / channels), gain_after(gain, gainStep, (first + 3) / channels)
+    );
+}
+
+// SSE2 has no 32-bit multiply, but gains fit in 16 bits, so build the full
+// products from the low and high halves of 16-bit multiplies
+__attribute__((target("sse2")))
+static int mix_add_sse2(int32_t* acc, int16_t const* src, int samples, int channels, int32_t gain, int32_t gainStep) {
+    __m128i gainLo = lane_gains_sse2(gain, gainStep, channels, 0);
+    __m128i gainHi = lane_gains_sse2(gain, gainStep, channels, 4);
+    __m128i advance = _mm_set1_epi32(gain_after(0, gainStep, 8 / channels));
+    int i = 0;
+    for (; i + 8 <= samples; i += 8)
+    {
+        __m128i s = _mm_loadu_si128((__m128i const*)(src + i));
+        __m128i g = _mm_packs_epi32(_mm_srai_epi32(gainLo, MIX_RAMP_BITS), _mm_srai_epi32(gainHi, MIX_RAMP_BITS));
+        __m128i lo = _mm_mullo_epi16(s, g), hi = _mm_mulhi_epi16(s, g);
+        __m128i p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), MIX_GAIN_BITS);
+        __m128i p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), MIX_GAIN_BITS);
+        _mm_storeu_si128((__m128i*)(acc + i), _mm_add_epi32(_mm_loadu_si128((__m128i const*)(acc + i)), p0));
+        _mm_storeu_si128((__m128i*)(acc + i + 4), _mm_add_epi32(_mm_loadu_si128((__m128i const*)(acc + i + 4)), p1));
+        gainLo = _mm_add_epi32(gainLo, advance);
+        gainHi = _mm_add_epi32(gainHi, advance);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int mix_add_avx2(int32_t* acc, int16_t const* src, int samples, int channels, int32_t gain, int32_t gainStep) {
+    __m256i gains = _mm256_setr_epi32(
+        gain_after(gain, gainStep, 0 / channels), gain_after(gain, gainStep, 1 / channels),
+        gain_after(gain, gainStep, 2 / channels), gain_after(gain, gainStep, 3 / channels),
+        gain_after(gain, gainStep, 4 / channels), gain_after(gain, gainStep, 5 / channels),
+        gain_after(gain, gainStep, 6 / channels), gain_after(gain, gainStep, 7 / channels)
+    );
+    __m256i advance = _mm256_set1_epi32(gain_after(0, gainStep, 8 / channels));
+    int i = 0;
+    for (; i + 8 <= samples; i += 8)
+    {
+        __m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i const*)(src + i)));
+        __m256i p = _mm256_mullo_epi32(s, _mm256_srai_epi32(gains, MIX_RAMP_BITS));
+        p = _mm256_srai_epi32(p, MIX_GAIN_BITS);
+        _mm256_storeu_si256((__m256i*)(acc + i), _mm256_add_epi32(_mm256_loadu_si256((__m256i const*)(acc + i)), p));
+        gains = _mm256_add_epi32(gains, advance);
+    }
+    return i;
+}
+
+__attribute__((target("sse2")))
+static int mix_store_sse2(int16_t* out, int32_t const* acc, int samples) {
+    int i = 0;
+    for (; i + 8 <= samples; i += 8)
+    {
+        __m128i a = _mm_loadu_si128((__m128i const*)(acc + i));
+        __m128i b = _mm_loadu_si128((__m128i const*)(acc + i + 4));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(a, b));
+    }
+    return i;
+}
+
+#endif
+
+int32_t mix_add(int32_t* acc, int16_t const* src, int frames, int channels, int32_t gain, int32_t gainStep) {
+    int samples = frames * channels;
+    int i = 0;
+#if defined(__x86_64__)
+    // Groups of 8 samples must be whole frames
+    if (8 % channels == 0)
+    {
+        if (__builtin_cpu_supports("avx2"))
+            i = mix_add_avx2(acc, src, samples, channels, gain, gainStep);
+        else if (__builtin_cpu_supports("sse2"))
+            i = mix_add_sse2(acc, src, samples, channels, gain, gainStep);
+    }
+#endif
+    // Finish off frame by frame from where the vector loop stopped
+    for (int frame = i / channels; frame < frames; frame++)
+    {
+        int32_t frameGain = gain_after(gain, gainStep, frame);
+        for (int c = 0; c < channels; c++)
+        {
+            acc[frame * channels + c] += scale(src[frame * channels + c], frameGain);
+        }
+    }
+    return gain_after(gain, gainStep, frames);
+}
+
+void mix_store(int16_t* out, int32_t const* acc, int samples) {
+    int i = 0;
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse2"))
+        i = mix_store_sse2(out, acc, samples);
+#endif
+    for (; i < samples; i++)
+    {
+        int32_t sample = acc[i];
+        out[i] = sample > INT16_MAX ? INT16_MAX : sample < INT16_MIN ? INT16_MIN : sample;
+    }
+}
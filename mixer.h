@@ -0,0 +1,27 @@
+#ifndef MIXER_H
+#define MIXER_H
+
+#include <stdint.h>
+
+// Gains are fixed point with MIX_GAIN_BITS fractional bits, so MIX_UNITY_GAIN
+// plays a sound at full volume. While ramping they carry MIX_RAMP_BITS more
+// fractional bits so slow fades still move every frame.
+#define MIX_GAIN_BITS 14
+#define MIX_UNITY_GAIN (1 << MIX_GAIN_BITS)
+#define MIX_RAMP_BITS 16
+
+// Ramped gain for an SDL volume from 0 to SDL_MIX_MAXVOLUME (128)
+#define MIX_VOLUME_GAIN(volume) ((int32_t)(volume) << (MIX_GAIN_BITS - 7 + MIX_RAMP_BITS))
+
+// Add frames of S16 samples (channels interleaved) to acc, each scaled by a
+// gain starting at gain and changing by gainStep every frame (both ramped
+// gains, see above). gain must stay between 0 and MIX_VOLUME_GAIN(128).
+// Returns the gain after the last frame. Uses SSE2/AVX2 where available and
+// gives exactly the same results either way.
+int32_t mix_add(int32_t* acc, int16_t const* src, int frames, int channels, int32_t gain, int32_t gainStep);
+
+// Clamp samples mixed by mix_add() to S16, clipping only once however many
+// sounds were added
+void mix_store(int16_t* out, int32_t const* acc, int samples);
+
+#endif
@@ -1,12 +1,9 @@
+#include <stdlib.h>
 #include <SDL2/SDL.h>
 
 #include "mysdl.h"
 #include "rect.h"
 
-int const WINDOW_WIDTH = 800;
-int const WINDOW_HEIGHT = 600;
-uint32_t const DELAY = 10;
-
 void set_render_colour(SDL_Renderer* renderer, Colour colour) {
     SDL_SetRenderDrawColor(renderer, colour.r, colour.g, colour.b, 255);
 }
@@ -33,3 +30,94 @@ void fill_rect_relative(SDL_Renderer* renderer, MovingRect rect, OrderedPair rel
     rect.pos = relative_pos(rect.pos, relativeTo);
     fill_rect(renderer, rect);
 }
+
+void queue_begin(RenderQueue* queue, SDL_Renderer* renderer) {
+    queue->renderer = renderer;
+    queue->numBatches = 0;
+    queue->current = NULL;
+    queue->calls = 0;
+}
+
+void queue_colour(RenderQueue* queue, Colour colour) {
+    for (int i = 0; i < queue->numBatches; i++)
+    {
+        Colour c = queue->batches[i].colour;
+        if (c.r == colour.r && c.g == colour.g && c.b == colour.b)
+        {
+            queue->current = &queue->batches[i];
+            return;
+        }
+    }
+    if (queue->numBatches == MAX_BATCH_COLOURS)
+        queue_flush(queue);
+    queue->current = &queue->batches[queue->numBatches++];
+    queue->current->colour = colour;
+    queue->current->count = 0;
+}
+
+// Add a rect already in SDL coordinates to the current batch
+static void queue_sdl_rect(RenderQueue* queue, SDL_Rect sdlRect) {
+    RectBatch* batch = queue->current;
+    if (batch->count == batch->capacity)
+    {
+        int capacity = batch->capacity ? batch->capacity * 2 : 64;
+        SDL_Rect* grown = realloc(batch->rects, capacity * sizeof(SDL_Rect));
+        if (!grown)
+        {
+            // Out of memory, draw it straight away instead
+            set_render_colour(queue->renderer, batch->colour);
+            SDL_RenderFillRect(queue->renderer, &sdlRect);
+            return;
+        }
+        batch->rects = grown;
+        batch->capacity = capacity;
+    }
+    batch->rects[batch->count++] = sdlRect;
+}
+
+void queue_rect(RenderQueue* queue, MovingRect rect) {
+    SDL_Rect sdlRect = {
+        .x = (int)rect.pos.x, .y = (int)rect.pos.y, 
+        .w = (int)rect.w, .h = (int)rect.h
+    };
+    sdlRect.x += WINDOW_WIDTH / 2;
+    sdlRect.y += WINDOW_HEIGHT / 2;
+    queue_sdl_rect(queue, sdlRect);
+}
+
+void queue_rect_standard(RenderQueue* queue, MovingRect rect) {
+    SDL_Rect sdlRect = {
+        .x = (int)rect.pos.x, .y = (int)rect.pos.y, 
+        .w = (int)rect.w, .h = (int)rect.h
+    };
+    queue_sdl_rect(queue, sdlRect);
+}
+
+void queue_rect_relative(RenderQueue* queue, MovingRect rect, OrderedPair relativeTo) {
+    rect.pos = relative_pos(rect.pos, relativeTo);
+    queue_rect(queue, rect);
+}
+
+void queue_flush(RenderQueue* queue) {
+    for (int i = 0; i < queue->numBatches; i++)
+    {
+        RectBatch* batch = &queue->batches[i];
+        if (batch->count == 0)
+            continue;
+        set_render_colour(queue->renderer, batch->colour);
+        SDL_RenderFillRects(queue->renderer, batch->rects, batch->count);
+        batch->count = 0;
+        queue->calls++;
+    }
+    queue->numBatches = 0;
+    queue->current = NULL;
+}
+
+void queue_free(RenderQueue* queue) {
+    for (int i = 0; i < MAX_BATCH_COLOURS; i++)
+    {
+        free(queue->batches[i].rects);
+        queue->batches[i].rects = NULL;
+        queue->batches[i].capacity = 0;
+    }
+}
@@ -5,18 +5,7 @@
 #include <SDL2/SDL.h>
 
 #include "rect.h"
-
-typedef struct Colour {
-    uint8_t r, g, b;
-} Colour;
-
-typedef uint64_t Time;
-
-extern int const WINDOW_WIDTH;
-extern int const WINDOW_HEIGHT;
-
-// How long to delay before updating in ms
-extern uint32_t const DELAY;
+#include "common.h"
 
 // Set render colour for next draw operation
 void set_render_colour(SDL_Renderer* renderer, Colour colour);
@@ -31,4 +20,45 @@ void fill_rect_standard(SDL_Renderer* renderer, MovingRect rect);
 // The given pos will be the considered the centre of the screen
 void fill_rect_relative(SDL_Renderer* renderer, MovingRect rect, OrderedPair relativeTo);
 
+// Rects of one colour waiting to be drawn
+typedef struct RectBatch {
+    Colour colour;
+    SDL_Rect* rects;
+    int count, capacity;
+} RectBatch;
+
+// Most colours one frame can queue before the queue has to be flushed early
+#define MAX_BATCH_COLOURS 8
+
+// Draw commands collected over a frame and grouped by colour, so each colour
+// costs one SDL_RenderFillRects call instead of a call per rect.
+// Each colour is drawn where it was first used in the frame, so a rect must not
+// need to cover an earlier rect of a colour that was first used before its own.
+// The rect arrays are kept between frames and only grow.
+typedef struct RenderQueue {
+    SDL_Renderer* renderer;
+    RectBatch batches[MAX_BATCH_COLOURS];
+    int numBatches;
+    // Batch the next rects go into
+    RectBatch* current;
+    // SDL_RenderFillRects calls made since queue_begin()
+    int calls;
+} RenderQueue;
+
+// Start a frame of draw commands for the given renderer
+void queue_begin(RenderQueue* queue, SDL_Renderer* renderer);
+
+// Set colour for the next queued rects
+void queue_colour(RenderQueue* queue, Colour colour);
+
+// Queue versions of fill_rect, fill_rect_standard and fill_rect_relative
+void queue_rect(RenderQueue* queue, MovingRect rect);
+void queue_rect_standard(RenderQueue* queue, MovingRect rect);
+void queue_rect_relative(RenderQueue* queue, MovingRect rect, OrderedPair relativeTo);
+
+// Draw everything queued, one SDL_RenderFillRects call per colour
+void queue_flush(RenderQueue* queue);
+
+void queue_free(RenderQueue* queue);
+
 #endif
@@ -104,3 +104,197 @@ Edge would_collide(MovingRect rect1, MovingRect rect2, float delta) {
     }
     return EDGE_NONE;
 }
+
+/*
+ * Batch collision.
+ * would_collide() checks each edge of rect1 against the opposite edge of rect2:
+ * the edges must cross during the move, and at the moment they meet the
+ * rectangles must overlap along the other axis. The code below does the same
+ * float operations in the same order, so the results match exactly, but with
+ * the probe's side worked out once and many rect2s tested at a time.
+ */
+
+// The probe's edges before and after moving, shared by every lane
+typedef struct ProbeEdges {
+    float x, y, w, h, dx, dy;
+    float top, left, bottom, right;
+    float topNew, leftNew, bottomNew, rightNew;
+} ProbeEdges;
+
+static ProbeEdges probe_edges(MovingRect const* probe, float delta) {
+    MovingRect moved = moved_rect(*probe, delta);
+    ProbeEdges p = {
+        .x = probe->pos.x, .y = probe->pos.y, .w = probe->w, .h = probe->h,
+        .dx = probe->dir.x, .dy = probe->dir.y,
+        .top = probe->pos.y, .left = probe->pos.x,
+        .bottom = probe->pos.y + probe->h, .right = probe->pos.x + probe->w,
+        .topNew = moved.pos.y, .leftNew = moved.pos.x,
+        .bottomNew = moved.pos.y + moved.h, .rightNew = moved.pos.x + moved.w
+    };
+    return p;
+}
+
+// Do the rectangles overlap along one axis once moved by t?
+static bool overlap_at(float pos1, float dir1, float size1, float pos2, float dir2, float size2, float t) {
+    float lo1 = pos1 + dir1 * t, lo2 = pos2 + dir2 * t;
+    float hi1 = lo1 + size1, hi2 = lo2 + size2;
+    return between(lo1, lo2, hi2) || between(hi1, lo2, hi2);
+}
+
+// Scalar version of one lane, for platforms without SIMD and the leftover tail
+static Edge collide_one(ProbeEdges const* p, float x, float y, float w, float h, float dx, float dy, float delta) {
+    float xNew = x + dx * delta, yNew = y + dy * delta;
+
+    // Probe's top edge against the other's bottom edge
+    float old2 = y + h, new2 = yNew + h;
+    if (p->top > old2 && !(p->topNew > new2))
+    {
+        float t = abs_float(p->top - old2) / abs_float(p->dy - dy);
+        if (overlap_at(p->x, p->dx, p->w, x, dx, w, t)) return EDGE_TOP;
+    }
+    // Left edge against right edge
+    old2 = x + w;
+    new2 = xNew + w;
+    if (p->left > old2 && !(p->leftNew > new2))
+    {
+        float t = abs_float(p->left - old2) / abs_float(p->dx - dx);
+        if (overlap_at(p->y, p->dy, p->h, y, dy, h, t)) return EDGE_LEFT;
+    }
+    // Bottom edge against top edge
+    if (!(p->bottom > y) && p->bottomNew > yNew)
+    {
+        float t = abs_float(p->bottom - y) / abs_float(p->dy - dy);
+        if (overlap_at(p->x, p->dx, p->w, x, dx, w, t)) return EDGE_BOTTOM;
+    }
+    // Right edge against left edge
+    if (!(p->right > x) && p->rightNew > xNew)
+    {
+        float t = abs_float(p->right - x) / abs_float(p->dx - dx);
+        if (overlap_at(p->y, p->dy, p->h, y, dy, h, t)) return EDGE_RIGHT;
+    }
+    return EDGE_NONE;
+}
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+/*
+ * Vector lanes, written once as macros over the SSE2 (4 lanes) and AVX2
+ * (8 lanes) instructions. Comparisons give all-ones masks, so
+ * "a && !b" is andnot(b, a) and "c ? x : y" is or(and(c, x), andnot(c, y)).
+ */
+#define DEFINE_COLLIDE_LANES(NAME, TARGET, VF, VI, SET1, LOADU, ADD, SUB, MUL, DIV, AND, ANDNOT, OR, XOR, GT, LT, MOVEMASK, CASTI, STOREI, LANES) \
+    __attribute__((target(TARGET))) \
+    static VF NAME##_abs(VF v, VF zero) { \
+        VF neg = LT(v, zero); \
+        return OR(AND(neg, XOR(v, SET1(-0.0f))), ANDNOT(neg, v)); \
+    } \
+    __attribute__((target(TARGET))) \
+    static VF NAME##_between(VF num, VF a, VF b) { \
+        return OR(AND(LT(a, num), LT(num, b)), AND(LT(b, num), LT(num, a))); \
+    } \
+    __attribute__((target(TARGET))) \
+    static VF NAME##_overlap_at(VF pos1, VF dir1, VF size1, VF pos2, VF dir2, VF size2, VF t) { \
+        VF lo1 = ADD(pos1, MUL(dir1, t)), lo2 = ADD(pos2, MUL(dir2, t)); \
+        VF hi1 = ADD(lo1, size1), hi2 = ADD(lo2, size2); \
+        return OR(NAME##_between(lo1, lo2, hi2), NAME##_between(hi1, lo2, hi2)); \
+    } \
+    __attribute__((target(TARGET))) \
+    static int NAME(ProbeEdges const* p, float const* xs, float const* ys, float const* ws, float const* hs, \
+                    float const* dxs, float const* dys, int n, float delta, Edge* out) { \
+        VF zero = SET1(0.0f), vDelta = SET1(delta); \
+        VF px = SET1(p->x), py = SET1(p->y), pw = SET1(p->w), ph = SET1(p->h); \
+        VF pdx = SET1(p->dx), pdy = SET1(p->dy); \
+        int i = 0; \
+        for (; i + LANES <= n; i += LANES) \
+        { \
+            VF x = LOADU(xs + i), y = LOADU(ys + i), w = LOADU(ws + i), h = LOADU(hs + i); \
+            VF dx = LOADU(dxs + i), dy = LOADU(dys + i); \
+            VF xNew = ADD(x, MUL(dx, vDelta)), yNew = ADD(y, MUL(dy, vDelta)); \
+            VF old2 = ADD(y, h), new2 = ADD(yNew, h); \
+            VF crosses = ANDNOT(GT(SET1(p->topNew), new2), GT(SET1(p->top), old2)); \
+            VF t = DIV(NAME##_abs(SUB(SET1(p->top), old2), zero), NAME##_abs(SUB(pdy, dy), zero)); \
+            VF hitTop = AND(crosses, NAME##_overlap_at(px, pdx, pw, x, dx, w, t)); \
+            old2 = ADD(x, w); \
+            new2 = ADD(xNew, w); \
+            crosses = ANDNOT(GT(SET1(p->leftNew), new2), GT(SET1(p->left), old2)); \
+            t = DIV(NAME##_abs(SUB(SET1(p->left), old2), zero), NAME##_abs(SUB(pdx, dx), zero)); \
+            VF hitLeft = AND(crosses, NAME##_overlap_at(py, pdy, ph, y, dy, h, t)); \
+            crosses = ANDNOT(GT(SET1(p->bottom), y), GT(SET1(p->bottomNew), yNew)); \
+            t = DIV(NAME##_abs(SUB(SET1(p->bottom), y), zero), NAME##_abs(SUB(pdy, dy), zero)); \
+            VF hitBottom = AND(crosses, NAME##_overlap_at(px, pdx, pw, x, dx, w, t)); \
+            crosses = ANDNOT(GT(SET1(p->right), x), GT(SET1(p->rightNew), xNew)); \
+            t = DIV(NAME##_abs(SUB(SET1(p->right), x), zero), NAME##_abs(SUB(pdx, dx), zero)); \
+            VF hitRight = AND(crosses, NAME##_overlap_at(py, pdy, ph, y, dy, h, t)); \
+            int anyHit = MOVEMASK(OR(OR(hitTop, hitLeft), OR(hitBottom, hitRight))); \
+            if (!anyHit) \
+            { \
+                for (int k = 0; k < LANES; k++) out[i + k] = EDGE_NONE; \
+                continue; \
+            } \
+            /* First edge hit wins, as in would_collide() */ \
+            VF edge = SET1(-1.0f); \
+            edge = OR(AND(hitRight, SET1(EDGE_RIGHT)), ANDNOT(hitRight, edge)); \
+            edge = OR(AND(hitBottom, SET1(EDGE_BOTTOM)), ANDNOT(hitBottom, edge)); \
+            edge = OR(AND(hitLeft, SET1(EDGE_LEFT)), ANDNOT(hitLeft, edge)); \
+            edge = OR(AND(hitTop, SET1(EDGE_TOP)), ANDNOT(hitTop, edge)); \
+            int32_t edges[LANES]; \
+            STOREI(edges, CASTI(edge)); \
+            for (int k = 0; k < LANES; k++) out[i + k] = (Edge)edges[k]; \
+        } \
+        return i; \
+    }
+
+#define STOREU_SI128(dst, v) _mm_storeu_si128((__m128i*)(dst), v)
+#define STOREU_SI256(dst, v) _mm256_storeu_si256((__m256i*)(dst), v)
+#define GT_PS256(a, b) _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define LT_PS256(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+
+DEFINE_COLLIDE_LANES(collide_sse2, "sse2", __m128, __m128i, _mm_set1_ps, _mm_loadu_ps,
+    _mm_add_ps, _mm_sub_ps, _mm_mul_ps, _mm_div_ps, _mm_and_ps, _mm_andnot_ps, _mm_or_ps, _mm_xor_ps,
+    _mm_cmpgt_ps, _mm_cmplt_ps, _mm_movemask_ps, _mm_cvttps_epi32, STOREU_SI128, 4)
+
+DEFINE_COLLIDE_LANES(collide_avx2, "avx2", __m256, __m256i, _mm256_set1_ps, _mm256_loadu_ps,
+    _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps, _mm256_div_ps, _mm256_and_ps, _mm256_andnot_ps, _mm256_or_ps, _mm256_xor_ps,
+    GT_PS256, LT_PS256, _mm256_movemask_ps, _mm256_cvttps_epi32, STOREU_SI256, 8)
+
+#endif
+
+bool would_collide_many_path(
+    CollidePath path,
+    MovingRect const* probe,
+    float const* xs, float const* ys, float const* ws, float const* hs,
+    float const* dxs, float const* dys,
+    int n, float delta, Edge* out
+) {
+    ProbeEdges p = probe_edges(probe, delta);
+    int i = 0;
+#if defined(__x86_64__)
+    bool avx2 = __builtin_cpu_supports("avx2"), sse2 = __builtin_cpu_supports("sse2");
+    if (path == COLLIDE_AUTO)
+        path = avx2 ? COLLIDE_AVX2 : sse2 ? COLLIDE_SSE2 : COLLIDE_SCALAR;
+    if ((path == COLLIDE_AVX2 && !avx2) || (path == COLLIDE_SSE2 && !sse2))
+        return false;
+    if (path == COLLIDE_AVX2)
+        i = collide_avx2(&p, xs, ys, ws, hs, dxs, dys, n, delta, out);
+    else if (path == COLLIDE_SSE2)
+        i = collide_sse2(&p, xs, ys, ws, hs, dxs, dys, n, delta, out);
+#else
+    if (path == COLLIDE_SSE2 || path == COLLIDE_AVX2)
+        return false;
+#endif
+    for (; i < n; i++)
+    {
+        out[i] = collide_one(&p, xs[i], ys[i], ws[i], hs[i], dxs[i], dys[i], delta);
+    }
+    return true;
+}
+
+void would_collide_many(
+    MovingRect const* probe,
+    float const* xs, float const* ys, float const* ws, float const* hs,
+    float const* dxs, float const* dys,
+    int n, float delta, Edge* out
+) {
+    would_collide_many_path(COLLIDE_AUTO, probe, xs, ys, ws, hs, dxs, dys, n, delta, out);
+}
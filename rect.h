@@ -37,4 +37,29 @@ typedef enum Edge {
 
 Edge would_collide(MovingRect rect1, MovingRect rect2, float delta);
 
+// Batch version of would_collide(probe, rect i, delta) for n rectangles given as
+// one array per field. The result for rectangle i is written to out[i].
+// Uses SSE2/AVX2 where available and gives exactly the same results as would_collide.
+void would_collide_many(
+    MovingRect const* probe,
+    float const* xs, float const* ys, float const* ws, float const* hs,
+    float const* dxs, float const* dys,
+    int n, float delta, Edge* out
+);
+
+// Ways would_collide_many() can run, fastest supported first by default
+typedef enum CollidePath {
+    COLLIDE_AUTO, COLLIDE_SCALAR, COLLIDE_SSE2, COLLIDE_AVX2
+} CollidePath;
+
+// would_collide_many() forced down one path, for checking each against
+// would_collide(). Returns false (writing nothing) if the CPU doesn't support it.
+bool would_collide_many_path(
+    CollidePath path,
+    MovingRect const* probe,
+    float const* xs, float const* ys, float const* ws, float const* hs,
+    float const* dxs, float const* dys,
+    int n, float delta, Edge* out
+);
+
 #endif
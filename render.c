@@ -0,0 +1,433 @@
+#include <stdbool.h>
+#include <math.h>
+#include <SDL2/SDL.h>
+
+#include "render.h"
+#include "world.h"
+#include "grid.h"
+#include "constants.h"
+#include "mysdl.h"
+#include "rect.h"
+
+// Most platforms/coins on screen to look up in the grid before falling back
+// to checking every one
+#define MAX_VISIBLE 512
+
+RenderStats renderStats;
+
+// Draw commands for the current frame, kept between frames to reuse memory
+static RenderQueue queue;
+
+/*
+ * Platforms never move, so they are drawn once into square tiles of
+ * TILE_SIZE world pixels and each frame just copies the few tiles on screen.
+ * Tiles are made when first needed and the least recently used is replaced,
+ * so this works for levels far bigger than one texture. A tile is remade once
+ * the world's layoutVersion changes (new level, endless chunks loaded).
+ */
+#define TILE_SIZE 1024
+#define MAX_TILES 16
+
+typedef struct Tile {
+    SDL_Texture* texture;
+    int col, row;
+    unsigned int layoutVersion;
+    bool valid;
+    // Frame it was last drawn
+    unsigned long lastUsed;
+} Tile;
+
+static Tile tiles[MAX_TILES];
+// Used to draw platforms into a tile
+static RenderQueue tileQueue;
+// Set once the renderer can't draw to textures, platforms are then drawn one by one
+static bool noTextures;
+
+// Coin display, only redrawn when the number of coins left changes
+static SDL_Texture* hudTexture;
+static int hudCoinsLeft = -1;
+
+// Copy of the last frame while the game is paused or over
+static SDL_Texture* frozenTexture;
+static bool frozenValid;
+
+// Area of the world on screen, centred on the player
+typedef struct Camera {
+    float left, top, right, bottom;
+} Camera;
+
+static Camera camera_around(OrderedPair centre) {
+    Camera camera = {
+        .left = centre.x - WINDOW_WIDTH / 2, .top = centre.y - WINDOW_HEIGHT / 2,
+        .right = centre.x + WINDOW_WIDTH / 2, .bottom = centre.y + WINDOW_HEIGHT / 2
+    };
+    return camera;
+}
+
+static bool on_screen(Camera const* camera, MovingRect const* rect) {
+    return rect->pos.x < camera->right && rect->pos.x + rect->w > camera->left
+        && rect->pos.y < camera->bottom && rect->pos.y + rect->h > camera->top;
+}
+
+// Queue rect if it is on screen, counting it as drawn or culled
+static void draw_if_visible(Camera const* camera, MovingRect const* rect, OrderedPair relativeTo) {
+    if (on_screen(camera, rect))
+    {
+        queue_rect_relative(&queue, *rect, relativeTo);
+        renderStats.drawn++;
+    }
+    else
+    {
+        renderStats.culled++;
+    }
+}
+
+// Draw the rects from an indexed array that are on screen, skipping hidden ones
+// (collected coins). Rects the grid rules out are counted as culled without
+// being looked at.
+static void draw_indexed(
+    Camera const* camera, SpatialGrid const* grid,
+    MovingRect const* rects, bool const* hidden, int n, OrderedPair relativeTo
+) {
+    int visible[MAX_VISIBLE];
+    int numVisible = grid_query(grid, camera->left, camera->top, camera->right, camera->bottom, visible, MAX_VISIBLE);
+    int numCandidates = numVisible < 0 ? n : numVisible;
+    for (int k = 0; k < numCandidates; k++)
+    {
+        int i = numVisible < 0 ? k : visible[k];
+        if (!hidden || !hidden[i])
+            draw_if_visible(camera, &rects[i], relativeTo);
+    }
+    renderStats.culled += n - numCandidates;
+}
+
+// Queue the grid of coins in the top-left corner, grey for collected ones
+static void draw_coin_display(RenderQueue* queue, int numCoinsLeft) {
+    for (int i = 0; i < NUM_COINS; i++)
+    {
+        Colour colour = (i < numCoinsLeft) ? coinColour : greyCoinColour;
+        int row = i / COIN_DISPLAY_GRID_SIZE;
+        int col = i % COIN_DISPLAY_GRID_SIZE;
+        queue_colour(queue, colour);
+        MovingRect coin;
+        coin.pos.x = coinDisplayWidth * (1 + col * 2);
+        coin.pos.y = coinDisplayWidth * (1 + row * 2);
+        coin.w = coinDisplayWidth;
+        coin.h = coinDisplayWidth;
+        queue_rect_standard(queue, coin);
+    }
+}
+
+// Make a texture to draw into, transparent where nothing is drawn
+static SDL_Texture* create_target(SDL_Renderer* renderer, int w, int h) {
+    SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h);
+    if (texture)
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    return texture;
+}
+
+// Start drawing into texture, cleared to transparent. Returns false on failure.
+static bool begin_target(SDL_Renderer* renderer, SDL_Texture* texture) {
+    if (SDL_SetRenderTarget(renderer, texture) != 0)
+        return false;
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+    SDL_RenderClear(renderer);
+    return true;
+}
+
+// Find or make the tile at (col, row). Returns NULL if it can't be made.
+static Tile* get_tile(SDL_Renderer* renderer, GameWorld const* world, int col, int row) {
+    Tile* tile = NULL;
+    for (int i = 0; i < MAX_TILES; i++)
+    {
+        Tile* t = &tiles[i];
+        if (t->valid && t->col == col && t->row == row && t->layoutVersion == world->layoutVersion)
+        {
+            t->lastUsed = renderStats.frames;
+            return t;
+        }
+        // Otherwise replace an unused tile, or the least recently used
+        if (!tile || (tile->valid && (!t->valid || t->lastUsed < tile->lastUsed)))
+            tile = t;
+    }
+
+    if (!tile->texture)
+        tile->texture = create_target(renderer, TILE_SIZE, TILE_SIZE);
+    if (!tile->texture)
+        return NULL;
+    tile->col = col;
+    tile->row = row;
+    tile->layoutVersion = world->layoutVersion;
+    tile->valid = true;
+    tile->lastUsed = renderStats.frames;
+
+    // Draw the platforms overlapping the tile, relative to its top-left corner
+    OrderedPair corner = { .x = col * TILE_SIZE, .y = row * TILE_SIZE };
+    int found[MAX_VISIBLE];
+    int numFound = grid_query(&world->platformGrid, corner.x, corner.y,
+        corner.x + TILE_SIZE, corner.y + TILE_SIZE, found, MAX_VISIBLE);
+    int numCandidates = numFound < 0 ? world->numPlatforms : numFound;
+    if (!begin_target(renderer, tile->texture))
+    {
+        tile->valid = false;
+        return NULL;
+    }
+    queue_begin(&tileQueue, renderer);
+    queue_colour(&tileQueue, platformColour);
+    for (int k = 0; k < numCandidates; k++)
+    {
+        MovingRect platform = world->platforms[numFound < 0 ? k : found[k]];
+        platform.pos = relative_pos(platform.pos, corner);
+        queue_rect_standard(&tileQueue, platform);
+    }
+    queue_flush(&tileQueue);
+    SDL_SetRenderTarget(renderer, NULL);
+    return tile;
+}
+
+// Make sure the tiles on screen are drawn. Returns false if tiles can't be used.
+static bool prepare_tiles(SDL_Renderer* renderer, GameWorld const* world, Camera const* camera) {
+    if (noTextures)
+        return false;
+    int col0 = (int)floorf(camera->left / TILE_SIZE), col1 = (int)floorf(camera->right / TILE_SIZE);
+    int row0 = (int)floorf(camera->top / TILE_SIZE), row1 = (int)floorf(camera->bottom / TILE_SIZE);
+    for (int row = row0; row <= row1; row++)
+    {
+        for (int col = col0; col <= col1; col++)
+        {
+            if (!get_tile(renderer, world, col, row))
+            {
+                noTextures = true;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Copy the tiles on screen, made by prepare_tiles()
+static void draw_tiles(SDL_Renderer* renderer, GameWorld const* world, Camera const* camera) {
+    int col0 = (int)floorf(camera->left / TILE_SIZE), col1 = (int)floorf(camera->right / TILE_SIZE);
+    int row0 = (int)floorf(camera->top / TILE_SIZE), row1 = (int)floorf(camera->bottom / TILE_SIZE);
+    for (int row = row0; row <= row1; row++)
+    {
+        for (int col = col0; col <= col1; col++)
+        {
+            Tile* tile = get_tile(renderer, world, col, row);
+            if (!tile)
+                continue;
+            SDL_Rect dest = {
+                .x = (int)(col * TILE_SIZE - camera->left), .y = (int)(row * TILE_SIZE - camera->top),
+                .w = TILE_SIZE, .h = TILE_SIZE
+            };
+            SDL_RenderCopy(renderer, tile->texture, NULL, &dest);
+            renderStats.calls++;
+        }
+    }
+}
+
+// Redraw the coin display texture if the number of coins left changed.
+// Returns false if the texture can't be used.
+static bool prepare_hud(SDL_Renderer* renderer, GameWorld const* world) {
+    if (noTextures)
+        return false;
+    int size = coinDisplayWidth * 2 * COIN_DISPLAY_GRID_SIZE;
+    if (!hudTexture)
+    {
+        hudTexture = create_target(renderer, size, size);
+        if (!hudTexture)
+        {
+            noTextures = true;
+            return false;
+        }
+        hudCoinsLeft = -1;
+    }
+    if (hudCoinsLeft == world->numCoinsLeft)
+        return true;
+
+    if (!begin_target(renderer, hudTexture))
+    {
+        noTextures = true;
+        return false;
+    }
+    hudCoinsLeft = world->numCoinsLeft;
+    queue_begin(&tileQueue, renderer);
+    draw_coin_display(&tileQueue, world->numCoinsLeft);
+    queue_flush(&tileQueue);
+    SDL_SetRenderTarget(renderer, NULL);
+    return true;
+}
+
+static void draw_hud(SDL_Renderer* renderer) {
+    int size = coinDisplayWidth * 2 * COIN_DISPLAY_GRID_SIZE;
+    SDL_Rect dest = { .x = 0, .y = 0, .w = size, .h = size };
+    SDL_RenderCopy(renderer, hudTexture, NULL, &dest);
+    renderStats.calls++;
+}
+
+static void draw_smile(void) {
+    MovingRect smile[5];
+    // Left eye
+    smile[0].pos.x = -2;
+    smile[0].pos.y = -2;
+    smile[0].w = 1;
+    smile[0].h = 1;
+    // Right eye
+    smile[1].pos.x = 1;
+    smile[1].pos.y = -2;
+    smile[1].w = 1;
+    smile[1].h = 1;
+    // Left side of mouth
+    smile[2].pos.x = -2;
+    smile[2].pos.y = 0;
+    smile[2].w = 1;
+    smile[2].h = 2;
+    // Right side of mouth
+    smile[3].pos.x = 1;
+    smile[3].pos.y = 0;
+    smile[3].w = 1;
+    smile[3].h = 2;
+    // Bottom of mouth
+    smile[4].pos.x = -1;
+    smile[4].pos.y = 1;
+    smile[4].w = 2;
+    smile[4].h = 1;
+    // Draw
+    queue_colour(&queue, faceColour);
+    for (int i = 0; i < 5; i++)
+    {
+        smile[i].dir.x *= facePixelSize;
+        smile[i].dir.y *= facePixelSize;
+        smile[i].pos.x *= facePixelSize;
+        smile[i].pos.y *= facePixelSize;
+        smile[i].w *= facePixelSize;
+        smile[i].h *= facePixelSize;
+        queue_rect(&queue, smile[i]);
+    }
+}
+
+// Bring cached textures up to date. This switches the render target, so do it
+// before drawing anything else. Returns false if they can't be used.
+static bool prepare_textures(SDL_Renderer* renderer, GameWorld const* world) {
+    Camera camera = camera_around(world->player.pos);
+    return prepare_tiles(renderer, world, &camera) && prepare_hud(renderer, world);
+}
+
+// Draw the world as seen from the player to the current render target
+static void draw_scene(SDL_Renderer* renderer, GameWorld const* world, bool useTextures) {
+    OrderedPair centre = world->player.pos;
+    Camera camera = camera_around(centre);
+
+    set_render_colour(renderer, bgColour);
+    SDL_RenderClear(renderer);
+    queue_begin(&queue, renderer);
+
+    // Draw player
+    queue_colour(&queue, playerColour);
+    queue_rect_relative(&queue, world->player, centre); // always draw player at centre of screen
+
+    // Draw bullets
+    queue_colour(&queue, bulletColour);
+    for (size_t i = 0; i < world->numBulletsSpawned; i++) {
+        draw_if_visible(&camera, &world->bullets[i].movingRect, centre);
+    }
+
+    // Draw platforms, over what has been queued so far
+    if (useTextures)
+    {
+        queue_flush(&queue);
+        draw_tiles(renderer, world, &camera);
+    }
+    else
+    {
+        queue_colour(&queue, platformColour);
+        draw_indexed(&camera, &world->platformGrid, world->platforms, NULL, world->numPlatforms, centre);
+    }
+
+    // Draw lava
+    queue_colour(&queue, bulletColour);
+    draw_if_visible(&camera, &world->lava, centre);
+
+    // Draw coins
+    queue_colour(&queue, coinColour);
+    draw_indexed(&camera, &world->coinGrid, world->coins, world->coinsCollected, world->numCoins, centre);
+
+    // Draw coin display
+    if (useTextures)
+    {
+        queue_flush(&queue);
+        draw_hud(renderer);
+    }
+    else
+    {
+        draw_coin_display(&queue, world->numCoinsLeft);
+    }
+
+    if (world->state == STATE_GAME_OVER_WON)
+    {
+        draw_smile();
+    }
+
+    queue_flush(&queue);
+    renderStats.calls += queue.calls;
+}
+
+void render(SDL_Renderer* renderer, GameWorld const* world) {
+    renderStats.frames++;
+    bool useTextures = prepare_textures(renderer, world);
+    draw_scene(renderer, world, useTextures);
+    SDL_RenderPresent(renderer); // buffer swap
+}
+
+void render_frozen(SDL_Renderer* renderer, GameWorld const* world) {
+    if (!frozenValid && !noTextures)
+    {
+        if (!frozenTexture)
+            frozenTexture = create_target(renderer, WINDOW_WIDTH, WINDOW_HEIGHT);
+        if (frozenTexture && prepare_textures(renderer, world) && begin_target(renderer, frozenTexture))
+        {
+            draw_scene(renderer, world, true);
+            SDL_SetRenderTarget(renderer, NULL);
+            frozenValid = true;
+        }
+    }
+    if (!frozenValid)
+    {
+        render(renderer, world);
+        return;
+    }
+    SDL_RenderCopy(renderer, frozenTexture, NULL, NULL);
+    SDL_RenderPresent(renderer);
+}
+
+void render_thaw(void) {
+    frozenValid = false;
+}
+
+
+void render_invalidate(void) {
+    for (int i = 0; i < MAX_TILES; i++)
+        tiles[i].valid = false;
+    hudCoinsLeft = -1;
+    frozenValid = false;
+}
+
+void render_free(void) {
+    for (int i = 0; i < MAX_TILES; i++)
+    {
+        if (tiles[i].texture)
+            SDL_DestroyTexture(tiles[i].texture);
+        tiles[i].texture = NULL;
+        tiles[i].valid = false;
+    }
+    if (hudTexture)
+        SDL_DestroyTexture(hudTexture);
+    hudTexture = NULL;
+    if (frozenTexture)
+        SDL_DestroyTexture(frozenTexture);
+    frozenTexture = NULL;
+    frozenValid = false;
+    noTextures = false;
+    queue_free(&queue);
+    queue_free(&tileQueue);
+}
@@ -0,0 +1,35 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <SDL2/SDL.h>
+
+#include "world.h"
+
+// Rects drawn and rects skipped for being off screen, since the last reset
+typedef struct RenderStats {
+    unsigned long frames;
+    unsigned long drawn;
+    unsigned long culled;
+    // SDL_RenderFillRects calls made
+    unsigned long calls;
+} RenderStats;
+
+extern RenderStats renderStats;
+
+// Draw the world as seen from the player and present it
+void render(SDL_Renderer* renderer, GameWorld const* world);
+
+// Present the world as it was at the first call since render_thaw(), from a
+// cached copy so nothing is redrawn while the world is standing still
+void render_frozen(SDL_Renderer* renderer, GameWorld const* world);
+
+// Forget the frozen frame, call once the world starts changing again
+void render_thaw(void);
+
+// Throw away cached textures, e.g. after the renderer lost their contents
+void render_invalidate(void);
+
+// Free cached textures, call before destroying the renderer
+void render_free(void);
+
+#endif
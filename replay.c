@@ -0,0 +1,124 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+#include "world.h"
+
+#define REPLAY_MAGIC "EVRP"
+// Bumped whenever the same seed and keys would play out differently
+#define REPLAY_VERSION 4
+#define REPLAY_ENDLESS 0x01
+// Bytes before the first tick
+#define REPLAY_HEADER_SIZE 24
+
+void replay_init(Replay* replay, uint64_t seed, unsigned int tickRate, bool endless) {
+    memset(replay, 0, sizeof(*replay));
+    replay->seed = seed;
+    replay->tickRate = tickRate;
+    replay->endless = endless;
+}
+
+void replay_free(Replay* replay) {
+    free(replay->ticks);
+    replay->ticks = NULL;
+    replay->numTicks = 0;
+    replay->capacity = 0;
+}
+
+uint8_t replay_pack(Keys const* keys, bool bulletHell) {
+    return (keys->l ? REPLAY_LEFT : 0) | (keys->r ? REPLAY_RIGHT : 0) | (keys->u ? REPLAY_UP : 0)
+        | (keys->d ? REPLAY_DOWN : 0) | (bulletHell ? REPLAY_BULLET_HELL : 0);
+}
+
+void replay_unpack(uint8_t tick, Keys* keys) {
+    keys->l = tick & REPLAY_LEFT;
+    keys->r = tick & REPLAY_RIGHT;
+    keys->u = tick & REPLAY_UP;
+    keys->d = tick & REPLAY_DOWN;
+}
+
+bool replay_record(Replay* replay, uint8_t tick) {
+    if (replay->numTicks == replay->capacity)
+    {
+        unsigned long capacity = replay->capacity ? replay->capacity * 2 : 4096;
+        uint8_t* ticks = realloc(replay->ticks, capacity);
+        if (!ticks)
+            return false;
+        replay->ticks = ticks;
+        replay->capacity = capacity;
+    }
+    replay->ticks[replay->numTicks++] = tick;
+    return true;
+}
+
+static void put_le(uint8_t* out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        out[i] = (value >> (8 * i)) & 0xff;
+}
+
+static uint64_t get_le(uint8_t const* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+        value |= (uint64_t)in[i] << (8 * i);
+    return value;
+}
+
+bool replay_save(Replay const* replay, char const* path) {
+    uint8_t header[REPLAY_HEADER_SIZE];
+    memcpy(header, REPLAY_MAGIC, 4);
+    put_le(header + 4, REPLAY_VERSION, 2);
+    put_le(header + 6, replay->endless ? REPLAY_ENDLESS : 0, 2);
+    put_le(header + 8, replay->seed, 8);
+    put_le(header + 16, replay->tickRate, 4);
+    put_le(header + 20, replay->numTicks, 4);
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Error opening %s\n", path);
+        return false;
+    }
+    bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header)
+        && fwrite(replay->ticks, 1, replay->numTicks, file) == replay->numTicks;
+    ok = fclose(file) == 0 && ok;
+    if (!ok)
+        fprintf(stderr, "Error writing %s\n", path);
+    return ok;
+}
+
+bool replay_load(Replay* replay, char const* path) {
+    memset(replay, 0, sizeof(*replay));
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "Error opening %s\n", path);
+        return false;
+    }
+    uint8_t header[REPLAY_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, REPLAY_MAGIC, 4) != 0
+            || get_le(header + 4, 2) != REPLAY_VERSION)
+    {
+        fprintf(stderr, "%s isn't a version %d replay\n", path, REPLAY_VERSION);
+        fclose(file);
+        return false;
+    }
+    replay->endless = get_le(header + 6, 2) & REPLAY_ENDLESS;
+    replay->seed = get_le(header + 8, 8);
+    replay->tickRate = get_le(header + 16, 4);
+    unsigned long numTicks = get_le(header + 20, 4);
+
+    replay->ticks = malloc(numTicks ? numTicks : 1);
+    bool ok = replay->ticks && replay->tickRate > 0 && fread(replay->ticks, 1, numTicks, file) == numTicks;
+    fclose(file);
+    if (!ok)
+    {
+        fprintf(stderr, "Error reading %s\n", path);
+        return false;
+    }
+    replay->numTicks = numTicks;
+    replay->capacity = numTicks;
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "world.h"
+
+// Bits of the key byte stored for each tick
+#define REPLAY_LEFT 0x01
+#define REPLAY_RIGHT 0x02
+#define REPLAY_UP 0x04
+#define REPLAY_DOWN 0x08
+// B was pressed just before this tick
+#define REPLAY_BULLET_HELL 0x10
+
+// Everything needed to play a game out again exactly: the world's seed and
+// tick rate, and which keys were held for every tick.
+//
+// On disk it is "EVRP", a 16 bit version, 16 bits of flags (bit 0 for endless
+// mode), the 64 bit seed, the 32 bit tick rate and 32 bit tick count, all little
+// endian, then one key byte per tick, so tick N is always at the same offset.
+typedef struct Replay {
+    uint64_t seed;
+    unsigned int tickRate;
+    bool endless;
+    uint8_t* ticks;
+    unsigned long numTicks;
+    unsigned long capacity;
+} Replay;
+
+// Start an empty recording of a game
+void replay_init(Replay* replay, uint64_t seed, unsigned int tickRate, bool endless);
+
+void replay_free(Replay* replay);
+
+// Key byte for the keys held during a tick
+uint8_t replay_pack(Keys const* keys, bool bulletHell);
+
+// Keys held during a tick from its key byte
+void replay_unpack(uint8_t tick, Keys* keys);
+
+// Add a tick to the end, returns false if out of memory
+bool replay_record(Replay* replay, uint8_t tick);
+
+// Returns false (after printing why) if the file couldn't be written
+bool replay_save(Replay const* replay, char const* path);
+
+// Returns false (after printing why) if the file couldn't be read or isn't a
+// replay of this version. Free the replay after either way.
+bool replay_load(Replay* replay, char const* path);
+
+#endif
@@ -0,0 +1,49 @@
+#include <stdint.h>
+
+#include "rng.h"
+
+#define PCG_MULTIPLIER 6364136223846793005ULL
+#define PCG_INCREMENT 1442695040888963407ULL
+
+// splitmix64 finaliser
+static uint64_t mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+void rng_seed(Rng* rng, uint64_t seed) {
+    rng->state = 0;
+    rng_next(rng);
+    rng->state += seed;
+    rng_next(rng);
+}
+
+uint32_t rng_next(Rng* rng) {
+    uint64_t old = rng->state;
+    rng->state = old * PCG_MULTIPLIER + PCG_INCREMENT;
+    uint32_t xorshifted = ((old >> 18) ^ old) >> 27;
+    uint32_t rot = old >> 59;
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+// Lemire's method: scale a 32 bit number up to [0, bound) with a multiply,
+// redrawing only the few numbers that would make some results more likely
+uint32_t rng_below(Rng* rng, uint32_t bound) {
+    uint64_t m = (uint64_t)rng_next(rng) * bound;
+    uint32_t low = (uint32_t)m;
+    if (low < bound)
+    {
+        uint32_t threshold = -bound % bound;
+        while (low < threshold)
+        {
+            m = (uint64_t)rng_next(rng) * bound;
+            low = (uint32_t)m;
+        }
+    }
+    return m >> 32;
+}
+
+uint64_t rng_hash(uint64_t a, uint64_t b) {
+    return mix(mix(a) ^ (b + 0x9e3779b97f4a7c15ULL));
+}
@@ -0,0 +1,24 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+// Small seedable random number generator (PCG32, XSH RR variant).
+// Unlike arc4random the same seed always gives the same numbers, and it is
+// just a multiply and an add with no locking, so it is cheap in tight loops.
+typedef struct Rng {
+    uint64_t state;
+} Rng;
+
+void rng_seed(Rng* rng, uint64_t seed);
+
+uint32_t rng_next(Rng* rng);
+
+// Random number in [0, bound), bound must be above 0. Every number is
+// equally likely, unlike rng_next() % bound.
+uint32_t rng_below(Rng* rng, uint32_t bound);
+
+// Mix two numbers into a well spread seed, e.g. a world seed and a chunk index
+uint64_t rng_hash(uint64_t a, uint64_t b);
+
+#endif
@@ -0,0 +1,52 @@
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "soundbank.h"
+#include "audio.h"
+#include "constants.h"
+
+unsigned int const soundVolume = SDL_MIX_MAXVOLUME * 2 / 3;
+
+typedef struct SoundFile {
+    char const* path;
+    // 1 for music, which loops and is streamed from disk rather than loaded
+    uint8_t loop;
+} SoundFile;
+
+static SoundFile const soundFiles[NUM_SOUNDS] = {
+    [SOUND_BGM] = { "assets/sound/bgm.wav", 1 },
+    [SOUND_COIN] = { "assets/sound/coin.wav", 0 },
+    [SOUND_WIN] = { "assets/sound/win.wav", 0 },
+    [SOUND_DEATH] = { "assets/sound/death.wav", 0 },
+};
+
+// Loaded sounds, NULL if not loaded or streamed
+static Audio* sounds[NUM_SOUNDS];
+
+void sound_bank_load(void) {
+    for (int i = 0; i < NUM_SOUNDS; i++)
+    {
+        if (!sounds[i] && !soundFiles[i].loop)
+            sounds[i] = createAudio(soundFiles[i].path, soundFiles[i].loop, SDL_MIX_MAXVOLUME);
+    }
+}
+
+void sound_bank_free(void) {
+    for (int i = 0; i < NUM_SOUNDS; i++)
+    {
+        if (sounds[i])
+            freeAudio(sounds[i]);
+        sounds[i] = NULL;
+    }
+}
+
+void sound_bank_play(SoundId id, int volume) {
+    if (soundFiles[id].loop)
+        crossfadeMusicStream(soundFiles[id].path, volume, musicFadeTime);
+    else if (sounds[id])
+        playSoundFromMemory(sounds[id], volume);
+}
+
+void sound_bank_stop_music(void) {
+    crossfadeMusicFromMemory(NULL, 0, musicFadeTime);
+}
@@ -0,0 +1,32 @@
+#ifndef SOUNDBANK_H
+#define SOUNDBANK_H
+
+// Every sound the game plays
+typedef enum SoundId {
+    SOUND_BGM,
+    SOUND_COIN,
+    SOUND_WIN,
+    SOUND_DEATH,
+    NUM_SOUNDS
+} SoundId;
+
+// Volume sounds are normally played at
+extern unsigned int const soundVolume;
+
+// Load every sound effect from disk, converted to the audio device's format,
+// so call after initAudio(). Sounds that fail to load are left silent.
+// Music isn't loaded, it is streamed from disk while it plays.
+void sound_bank_load(void);
+
+// Free every loaded sound, the audio device must be closed first
+void sound_bank_free(void);
+
+// Play a loaded sound without touching the disk. Music starts streaming and
+// crossfades from the current music, carrying on if it is already playing.
+// Does nothing if the sound isn't loaded or audio isn't initialised.
+void sound_bank_play(SoundId id, int volume);
+
+// Fade the current music out to silence
+void sound_bank_stop_music(void);
+
+#endif
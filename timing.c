@@ -0,0 +1,86 @@
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "timing.h"
+
+void fixed_step_init(FixedStep* step, unsigned int tickRate, int maxStepsPerFrame) {
+    step->frequency = SDL_GetPerformanceFrequency();
+    step->tickRate = tickRate;
+    step->stepMs = 1000.0f / tickRate;
+    step->maxStepsPerFrame = maxStepsPerFrame;
+    fixed_step_reset(step);
+}
+
+int fixed_step_advance(FixedStep* step) {
+    uint64_t now = SDL_GetPerformanceCounter();
+    // Multiply instead of dividing so no time is lost to rounding
+    step->accumulator += (now - step->lastCounter) * step->tickRate;
+    step->lastCounter = now;
+
+    int steps = 0;
+    while (step->accumulator >= step->frequency)
+    {
+        if (steps == step->maxStepsPerFrame)
+        {
+            // Too far behind, drop the rest rather than spiral
+            step->accumulator = 0;
+            break;
+        }
+        step->accumulator -= step->frequency;
+        steps++;
+    }
+    return steps;
+}
+
+uint64_t fixed_step_time(FixedStep const* step, int stepsLeft) {
+    uint64_t behind = (step->accumulator + (uint64_t)stepsLeft * step->frequency) / step->tickRate;
+    return behind < step->lastCounter ? step->lastCounter - behind : 0;
+}
+
+void fixed_step_reset(FixedStep* step) {
+    step->lastCounter = SDL_GetPerformanceCounter();
+    step->accumulator = 0;
+}
+
+void frame_pacer_init(FramePacer* pacer, unsigned int fps, double spinMs) {
+    pacer->frequency = SDL_GetPerformanceFrequency();
+    pacer->frameTicks = fps ? pacer->frequency / fps : 0;
+    pacer->spinTicks = (uint64_t)(spinMs * pacer->frequency / 1000);
+    pacer->nextFrame = SDL_GetPerformanceCounter();
+}
+
+void frame_pacer_wait(FramePacer* pacer) {
+    if (pacer->frameTicks == 0)
+        return;
+    uint64_t now = SDL_GetPerformanceCounter();
+    if (now < pacer->nextFrame)
+    {
+        uint64_t remaining = pacer->nextFrame - now;
+        if (pacer->spinTicks == 0)
+        {
+            // Not spinning: sleep the whole wait, rounded up to a ms so the
+            // frame is never early. nextFrame still advances by exactly one
+            // frame, so oversleeping doesn't add up over frames.
+            SDL_Delay((uint32_t)((remaining * 1000 + pacer->frequency - 1) / pacer->frequency));
+        }
+        else
+        {
+            // Sleep for whole ms of the remaining budget, keeping back the spin time
+            if (remaining > pacer->spinTicks)
+            {
+                uint64_t sleepMs = (remaining - pacer->spinTicks) * 1000 / pacer->frequency;
+                if (sleepMs > 0)
+                    SDL_Delay((uint32_t)sleepMs);
+            }
+            // Then spin for whatever is left
+            while (SDL_GetPerformanceCounter() < pacer->nextFrame) {}
+        }
+        pacer->nextFrame += pacer->frameTicks;
+    }
+    else
+    {
+        // Running late, start counting again from now rather than rushing
+        // out frames to catch up
+        pacer->nextFrame = now + pacer->frameTicks;
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+
+// Fixed-timestep accumulator driven by the high resolution performance counter.
+// Real elapsed time is banked and paid out in whole simulation steps of equal
+// length, so the simulation gives the same results however long frames take.
+typedef struct FixedStep {
+    // Performance counter ticks per second
+    uint64_t frequency;
+    // Simulation steps per second
+    unsigned int tickRate;
+    // Length of one step in ms, pass this to world_step()
+    float stepMs;
+    // Most steps to run for one frame, the rest of a long stall is dropped
+    int maxStepsPerFrame;
+    uint64_t lastCounter;
+    // Banked time in units of 1 / (frequency * tickRate) seconds
+    uint64_t accumulator;
+} FixedStep;
+
+// Start the clock now
+void fixed_step_init(FixedStep* step, unsigned int tickRate, int maxStepsPerFrame);
+
+// Number of steps due since the last call (at most maxStepsPerFrame)
+int fixed_step_advance(FixedStep* step);
+
+// Performance counter value (real time) that a step due from the last
+// fixed_step_advance() stands for, with stepsLeft counting that step and every
+// one after it. Steps are spread evenly up to the time still banked.
+uint64_t fixed_step_time(FixedStep const* step, int stepsLeft);
+
+// Forget any banked time, e.g. after a long pause
+void fixed_step_reset(FixedStep* step);
+
+// Sleeps between frames so they start a fixed time apart, however long the
+// work in each frame took
+typedef struct FramePacer {
+    // Performance counter ticks per second
+    uint64_t frequency;
+    // Counter ticks per frame, 0 to not wait at all (e.g. vsync does the pacing)
+    uint64_t frameTicks;
+    // Busy-wait instead of sleeping for the last this many counter ticks,
+    // since SDL_Delay can oversleep by a millisecond or more. 0 never spins.
+    uint64_t spinTicks;
+    // Counter value the next frame is due at
+    uint64_t nextFrame;
+} FramePacer;
+
+// Start pacing frames at fps per second (0 for no limit), spinning for the
+// last spinMs of each wait (0 to only sleep)
+void frame_pacer_init(FramePacer* pacer, unsigned int fps, double spinMs);
+
+// Wait until the next frame is due
+void frame_pacer_wait(FramePacer* pacer);
+
+#endif
@@ -0,0 +1,365 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "world.h"
+#include "constants.h"
+#include "rect.h"
+#include "grid.h"
+#include "chunk.h"
+
+// Most grid query results to consider before falling back to a full scan
+#define MAX_NEARBY 64
+// Number of rects gathered for each would_collide_many() call
+#define COLLIDE_BATCH 64
+
+// Rects gathered into one array per field for would_collide_many()
+typedef struct CollideBatch {
+    float x[COLLIDE_BATCH], y[COLLIDE_BATCH], w[COLLIDE_BATCH], h[COLLIDE_BATCH];
+    float dx[COLLIDE_BATCH], dy[COLLIDE_BATCH];
+    // Index of each rect in the array it was gathered from
+    int index[COLLIDE_BATCH];
+    Edge edges[COLLIDE_BATCH];
+    int n;
+} CollideBatch;
+
+GameWorld* world_create(void) {
+    GameWorld* world = calloc(1, sizeof(GameWorld));
+    if (world)
+        world_default_params(&world->params);
+    return world;
+}
+
+void world_default_params(WorldParams* params) {
+    params->playerJumpSpeed = playerJumpSpeed;
+    params->gravity = gravity;
+    params->maxBulletDelay = maxBulletDelay;
+    params->minBulletDelay = minBulletDelay;
+}
+
+void world_destroy(GameWorld* world) {
+    if (!world)
+        return;
+    grid_free(&world->platformGrid);
+    grid_free(&world->coinGrid);
+    free(world);
+}
+
+// Game over, won or lost
+static void game_over(GameWorld* world, bool won) {
+    world->state = won ? STATE_GAME_OVER_WON : STATE_GAME_OVER_LOST;
+}
+
+// Index platforms and coins by the grid they were laid out on.
+// If this fails the queries report it and world_step() scans everything.
+static void build_grids(GameWorld* world) {
+    world->layoutVersion++;
+    float cellW = platformSeparation + platformWidth;
+    float cellH = platformSeparation + platformHeight;
+    if (!grid_build(&world->platformGrid, world->platforms, world->numPlatforms, cellW, cellH))
+        grid_free(&world->platformGrid);
+    if (!grid_build(&world->coinGrid, world->coins, world->numCoins, cellW, cellH))
+        grid_free(&world->coinGrid);
+}
+
+// Generate the fixed size level, coins spread at random over the platforms
+static void setup_fixed_level(GameWorld* world) {
+    int coinCount = 0;
+    world->numPlatforms = NUM_PLATFORMS;
+    world->numCoins = NUM_COINS;
+
+    // Create platforms, spread in grid with some random variation
+    for (size_t i = 0; i < NUM_PLATFORMS; i++)
+    {
+        MovingRect* platform = &world->platforms[i];
+        // No movement for platforms
+        platform->dir.x = 0;
+        platform->dir.y = 0;
+
+        // Positioning
+        int col = i % PLATFORM_GRID_SIZE;
+        int row = i / PLATFORM_GRID_SIZE;
+        platform->pos.x = col * (platformSeparation + platformWidth) + (int)rng_below(&world->rng, platformSeparation);
+        platform->pos.y = row * (platformSeparation + platformHeight) + (int)rng_below(&world->rng, platformSeparation);
+
+        // Size
+        platform->w = platformWidth;
+        platform->h = platformHeight;
+
+        // Spawn player above starting platform
+        if (row == 0 && col == PLATFORM_GRID_SIZE / 2)
+        {
+            world->player.pos = platform->pos;
+            world->player.pos.y -= platformSeparation;
+        }
+
+        // Spawn coin if needed. Each platform gets one with probability coins
+        // left to place / platforms left (selection sampling), which picks
+        // every set of NUM_COINS platforms equally often in a single pass.
+        if (rng_below(&world->rng, NUM_PLATFORMS - i) < (uint32_t)(NUM_COINS - coinCount))
+        {
+            MovingRect* coin = &world->coins[coinCount];
+            coin->dir.x = 0;
+            coin->dir.y = 0;
+            coin->pos = platform->pos;
+            coin->pos.y -= platformHeight + 1;
+            coin->pos.x += (platformWidth - coinSize) / 2;
+            coin->w = coinSize;
+            coin->h = coinSize;
+            coinCount++;
+        }
+    }
+}
+
+void world_setup(GameWorld* world) {
+
+    world->state = STATE_CONTINUE;
+    rng_seed(&world->rng, world->seed);
+    memset(&world->events, 0, sizeof(world->events));
+    world->time = 0;
+
+    world->lastBulletSpawnTime = 0;
+    world->nextBulletNum = 0;
+    world->numBulletsSpawned = 0;
+
+    MovingRect* player = &world->player;
+    player->pos.x = 0;
+    player->pos.y = 0;
+    player->w = PLAYER_SIZE;
+    player->h = PLAYER_SIZE;
+    player->dir.x = 0;
+    player->dir.y = 0;
+
+    world->bulletDelay = world->params.maxBulletDelay;
+
+    memset(world->coinsCollected, false, sizeof(world->coinsCollected));
+    world->numCoinsLeft = NUM_COINS;
+
+    if (world->endless)
+    {
+        chunks_setup(world);
+        // Spawn player above the middle of the first row of chunk 0
+        player->pos = world->platforms[CHUNK_COLS / 2].pos;
+        player->pos.y -= platformSeparation;
+    }
+    else
+    {
+        setup_fixed_level(world);
+    }
+
+    // Create lava
+    MovingRect* lava = &world->lava;
+    lava->pos.y = PLATFORM_GRID_SIZE * (platformSeparation + platformHeight) + WINDOW_HEIGHT; // add
+    // window height to ensure it is out of view
+    int platformAreaWidth = PLATFORM_GRID_SIZE * (platformSeparation + platformWidth);
+    lava->pos.x = -platformAreaWidth;
+    lava->w = platformAreaWidth * 3;
+    lava->h = lava->w;
+    lava->dir.x = 0;
+    lava->dir.y = 0;
+
+    build_grids(world);
+}
+
+// Find the rects in grid the player could touch during a step of dt ms.
+// Returns the number of indices written to out, or -1 if every rect must be checked.
+static int query_nearby(SpatialGrid const* grid, MovingRect const* player, float dt, int* out) {
+    MovingRect moved = moved_rect(*player, dt);
+    // Box swept by the player, padded to allow for rounding
+    float left = fminf(player->pos.x, moved.pos.x) - 1;
+    float top = fminf(player->pos.y, moved.pos.y) - 1;
+    float right = fmaxf(player->pos.x, moved.pos.x) + player->w + 1;
+    float bottom = fmaxf(player->pos.y, moved.pos.y) + player->h + 1;
+    return grid_query(grid, left, top, right, bottom, out, MAX_NEARBY);
+}
+
+static void batch_add(CollideBatch* batch, MovingRect const* rect, int index) {
+    int n = batch->n++;
+    batch->x[n] = rect->pos.x;
+    batch->y[n] = rect->pos.y;
+    batch->w[n] = rect->w;
+    batch->h[n] = rect->h;
+    batch->dx[n] = rect->dir.x;
+    batch->dy[n] = rect->dir.y;
+    batch->index[n] = index;
+}
+
+// Fill in batch->edges with which edge of the player would hit each rect
+static void batch_collide(CollideBatch* batch, MovingRect const* player, float dt) {
+    would_collide_many(
+        player, batch->x, batch->y, batch->w, batch->h, batch->dx, batch->dy,
+        batch->n, dt, batch->edges
+    );
+}
+
+// Spawn a new bullet, replacing the oldest one if there is no more space
+static void spawn_bullet(GameWorld* world)
+{
+    size_t i = world->nextBulletNum;
+    world->nextBulletNum++;
+    if (world->nextBulletNum == MAX_BULLETS)
+        world->nextBulletNum = 0;
+    if (world->numBulletsSpawned < MAX_BULLETS)
+        world->numBulletsSpawned++;
+    Bullet* bullet = world->bullets + i;
+    MovingRect* player = &world->player;
+
+    bullet->movingRect.w = BULLET_SIZE;
+    bullet->movingRect.h = BULLET_SIZE;
+
+    // Random bullet spawn location
+    OrderedPair pos;
+    if (rng_below(&world->rng, 2) == 0)
+    {
+        // spawn on top/bottom edge
+        pos.y = player->pos.y + WINDOW_HEIGHT / 2 * pow(-1, rng_below(&world->rng, 2));
+        pos.x = player->pos.x - WINDOW_WIDTH / 2 + (int)rng_below(&world->rng, WINDOW_WIDTH);
+    } else {
+        // spawn on left-right edge
+        pos.x = player->pos.x + WINDOW_WIDTH / 2 * pow(-1, rng_below(&world->rng, 2));
+        pos.y = player->pos.y - WINDOW_HEIGHT / 2 + (int)rng_below(&world->rng, WINDOW_HEIGHT);
+    }
+    bullet->movingRect.pos = pos;
+
+    // Bullet goes toward player
+    bullet->movingRect.dir = scaled_vector(relative_pos(player->pos, bullet->movingRect.pos), playerHorizontalSpeed);
+}
+
+void world_step(GameWorld* world, const Keys* input, float dt) {
+
+    memset(&world->events, 0, sizeof(world->events));
+    world->time += dt;
+
+    // Should I spawn a bullet on this iteration?
+    if (world->time > world->lastBulletSpawnTime + world->bulletDelay)
+    {
+        world->lastBulletSpawnTime = world->time;
+        spawn_bullet(world);
+    }
+
+    MovingRect* player = &world->player;
+
+    if (world->endless)
+    {
+        if (chunks_update(world))
+            build_grids(world);
+        // Lava follows the player since the level never ends
+        world->lava.pos.x = player->pos.x - world->lava.w / 2;
+    }
+
+    // Set player velocity
+    player->dir.x = 0;
+    if (input->l) player->dir.x = -playerHorizontalSpeed;
+    else if (input->r) player->dir.x = playerHorizontalSpeed;
+    player->dir.y += world->params.gravity * dt;
+    // Don't exceed terminal velocity
+    if (player->dir.y > terminalVelocity)
+        player->dir.y = terminalVelocity;
+    bool onPlatform = false;
+    // Only the platforms near the player are checked, in index order so the
+    // first one hit is the same as with a full scan
+    CollideBatch batch;
+    int nearby[MAX_NEARBY];
+    int numNearby = query_nearby(&world->platformGrid, player, dt, nearby);
+    int numCandidates = numNearby < 0 ? world->numPlatforms : numNearby;
+    for (int start = 0; start < numCandidates && !onPlatform; start += COLLIDE_BATCH)
+    {
+        batch.n = 0;
+        for (int k = start; k < numCandidates && batch.n < COLLIDE_BATCH; k++)
+        {
+            int i = numNearby < 0 ? k : nearby[k];
+            batch_add(&batch, &world->platforms[i], i);
+        }
+        batch_collide(&batch, player, dt);
+        for (int b = 0; b < batch.n; b++)
+        {
+            if (batch.edges[b] == EDGE_BOTTOM)
+            {
+                onPlatform = true;
+                player->pos.y = world->platforms[batch.index[b]].pos.y - PLAYER_SIZE - 0.0001;
+                player->dir.y = 0;
+                break;
+            }
+        }
+    }
+    if (onPlatform && input->u)
+        player->dir.y = -world->params.playerJumpSpeed;
+
+    // Collecting coins
+    numNearby = query_nearby(&world->coinGrid, player, dt, nearby);
+    numCandidates = numNearby < 0 ? world->numCoins : numNearby;
+    for (int start = 0; start < numCandidates; start += COLLIDE_BATCH)
+    {
+        batch.n = 0;
+        for (int k = start; k < numCandidates && batch.n < COLLIDE_BATCH; k++)
+        {
+            int i = numNearby < 0 ? k : nearby[k];
+            if (!world->coinsCollected[i])
+                batch_add(&batch, &world->coins[i], i);
+        }
+        batch_collide(&batch, player, dt);
+        for (int b = 0; b < batch.n; b++)
+        {
+            if (batch.edges[b] == EDGE_NONE)
+                continue;
+            // Coin collected
+            world->numCoinsLeft--;
+            world->coinsCollected[batch.index[b]] = true;
+            world->events.coinsCollected++;
+            if (NUM_COINS != 1)
+            {
+                // Avoid division by 0
+                Time minDelay = world->params.minBulletDelay;
+                Time decrease = world->params.maxBulletDelay > minDelay
+                    ? (world->params.maxBulletDelay - minDelay) / (NUM_COINS - 1) : 0;
+                // Never wrap around, and never slow down bullet hell
+                if (world->bulletDelay >= minDelay + decrease)
+                    world->bulletDelay -= decrease;
+                else if (world->bulletDelay > minDelay)
+                    world->bulletDelay = minDelay;
+            }
+            if (world->numCoinsLeft == 0)
+            {
+                if (world->endless)
+                    world->numCoinsLeft = NUM_COINS;
+                else
+                    game_over(world, true);
+            }
+        }
+    }
+
+    // Bullets, checked against where they are before moving
+    for (unsigned int start = 0; start < world->numBulletsSpawned; start += COLLIDE_BATCH)
+    {
+        batch.n = 0;
+        for (unsigned int i = start; i < world->numBulletsSpawned && batch.n < COLLIDE_BATCH; i++)
+            batch_add(&batch, &world->bullets[i].movingRect, i);
+        batch_collide(&batch, player, dt);
+        for (int b = 0; b < batch.n; b++)
+        {
+            if (batch.edges[b] != EDGE_NONE && world->state == STATE_CONTINUE)
+            {
+                // Player collided with bullet
+                game_over(world, false);
+            }
+        }
+    }
+
+    // Move bullets
+    for (size_t i = 0; i < world->numBulletsSpawned; i++) {
+        move_rect(&(world->bullets[i].movingRect), dt);
+    }
+
+    // Collision with lava
+    if (would_collide(*player, world->lava, dt) != EDGE_NONE)
+    {
+        game_over(world, false);
+    }
+
+    // Move player
+    move_rect(player, dt);
+}
+
+void world_bullet_hell(GameWorld* world) {
+    world->bulletDelay = 100;
+}
@@ -0,0 +1,102 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "constants.h"
+#include "rect.h"
+#include "grid.h"
+#include "rng.h"
+
+// Which keys are currently pressed
+typedef struct Keys {
+    bool l, r, u, d;
+} Keys;
+
+// Things that happened during the last world_step() that the caller may want
+// to react to (e.g. play a sound). The simulation itself never touches SDL.
+typedef struct WorldEvents {
+    int coinsCollected;
+} WorldEvents;
+
+// Difficulty tuning, which can differ between worlds (e.g. for a batch of
+// games trying several settings at once). world_create() fills it in with the
+// defaults from constants.h.
+typedef struct WorldParams {
+    // Vertical player speed after jump
+    float playerJumpSpeed;
+    // Downward acceleration of the player in px/ms per ms. world_step() adds
+    // gravity * dt to the vertical speed, so it is the same at any tick rate.
+    float gravity;
+    // Time between bullet spawns in ms, at the start and with every coin
+    // collected, shrinking evenly from max to min
+    Time maxBulletDelay;
+    Time minBulletDelay;
+} WorldParams;
+
+// All simulation state for one game
+typedef struct GameWorld {
+    GameState state;
+    WorldEvents events;
+    WorldParams params;
+
+    // Endless mode (see chunk.h), set before world_setup()
+    bool endless;
+    // Seed the level and bullets are generated from, set before world_setup().
+    // The same seed and key presses always play out the same way.
+    uint64_t seed;
+    Rng rng;
+    // First chunk loaded in endless mode
+    int firstChunk;
+
+    // Simulation time in ms, advanced by world_step()
+    double time;
+    // Time of last bullet spawn in ms
+    double lastBulletSpawnTime;
+    // Time to wait before spawning next bullet
+    Time bulletDelay;
+
+    MovingRect player;
+
+    Bullet bullets[MAX_BULLETS];
+    unsigned int numBulletsSpawned;
+    int nextBulletNum;
+
+    MovingRect platforms[MAX_PLATFORMS];
+    int numPlatforms;
+    // Big wall of red below all the platforms, touch it and you die
+    MovingRect lava;
+
+    MovingRect coins[MAX_COINS];
+    int numCoins;
+    // Coins left to collect to win, in endless mode this refills once empty
+    int numCoinsLeft;
+    bool coinsCollected[MAX_COINS];
+
+    // Spatial indexes over platforms and coins, built by world_setup()
+    SpatialGrid platformGrid;
+    SpatialGrid coinGrid;
+    // Changes whenever platforms or coins are regenerated, so anything
+    // cached from them knows to rebuild
+    unsigned int layoutVersion;
+} GameWorld;
+
+// Allocate a world with the default params, returns NULL on failure. Call
+// world_setup() before stepping.
+GameWorld* world_create(void);
+
+void world_default_params(WorldParams* params);
+
+void world_destroy(GameWorld* world);
+
+// Generate a new level from world->seed and reset the player, bullets and clock
+void world_setup(GameWorld* world);
+
+// Advance the simulation by dt ms using the given key state
+void world_step(GameWorld* world, const Keys* input, float dt);
+
+// Drastically increase the rate at which bullets spawn
+void world_bullet_hell(GameWorld* world);
+
+#endif